@@ -0,0 +1,69 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_ALLOC_H
+#define CCSTREAMS_ALLOC_H 1
+
+#include <stddef.h>
+
+/* An allocator for the buffers of the streams (and the state the streams
+ * keep for them), e.g. to place them in an arena or pool. context is passed
+ * back to each function. The sizes passed to grow and free are the sizes of
+ * the allocations as known to the stream: what it asked for itself, or the
+ * size (or capacity) it was given with a buffer the caller provided.
+ *
+ * alloc: Return size bytes (size may be 0), or NULL on failure with errno
+ *        set.
+ *
+ * grow:  Resize the allocation at ptr from old_size to size bytes (which may
+ *        be smaller, but never 0), keeping its contents. Return the new
+ *        allocation, or NULL on failure with errno set and ptr untouched.
+ *
+ * free:  Release the allocation at ptr of size bytes.
+ *
+ * The allocator is copied when a stream is opened. Memory the stream hands
+ * back to the caller (e.g. the buffer of a mem stream) must be released
+ * through the same allocator.
+ */
+struct ccstreams_allocator {
+  void *(*alloc)(void *context, size_t size);
+  void *(*grow)(void *context, void *ptr, size_t old_size, size_t size);
+  void (*free)(void *context, void *ptr, size_t size);
+  void *context;
+};
+
+/* An allocator that gives each allocation its own anonymous mapping
+ * (mmap(...)) and grows it with mremap(...), so growing a buffer moves page
+ * table entries instead of copying the data.
+ *
+ * Every allocation takes at least a page, so this is meant for a few large
+ * buffers (e.g. staging gigabytes in a mem stream) rather than many small
+ * ones. The size given to free must be the size of the allocation, as the
+ * streams do (see the allocated option of ccstreams_fmemopen_options(...)
+ * for a buffer handed back larger than its data).
+ */
+extern const struct ccstreams_allocator ccstreams_allocator_mmap;
+
+/* As ccstreams_allocator_mmap, but mappings of 2 MiB and up are also marked
+ * for transparent huge pages (MADV_HUGEPAGE). This saves TLB misses when a
+ * large buffer is walked, at the cost of memory being committed 2 MiB at a
+ * time. Without THP the hint is ignored.
+ */
+extern const struct ccstreams_allocator ccstreams_allocator_mmap_huge;
+
+#endif /* CCSTREAMS_ALLOC_H */
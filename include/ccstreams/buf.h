@@ -0,0 +1,81 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_BUF_H
+#define CCSTREAMS_BUF_H 1
+
+#include <stdio.h>
+
+/* What a stream returned by ccstreams_fbufopen(...) does with output that
+ * doesn't fit in the buffer.
+ *
+ * CCSTREAMS_BUF_TRUNCATE: Keep what fits and silently drop the rest (as
+ *                         snprintf(...) does).
+ * CCSTREAMS_BUF_FAIL:     Fail output that doesn't fit (with ENOSPC),
+ *                         leaving what was written before it. stdio may
+ *                         split a call, so part of the failing call can be
+ *                         kept too.
+ * CCSTREAMS_BUF_SPILL:    Move the data to a buffer on the heap (replacing
+ *                         *buf) and grow that as needed, as for a mem stream.
+ *                         The caller then frees *buf after the stream is
+ *                         closed.
+ */
+enum ccstreams_buf_overflow {
+  CCSTREAMS_BUF_TRUNCATE,
+  CCSTREAMS_BUF_FAIL,
+  CCSTREAMS_BUF_SPILL,
+};
+
+/* Create a stream over a fixed buffer of capacity bytes provided by the
+ * caller (e.g. on the stack) that holds *length bytes of data. The buffer is
+ * never reallocated (unless it spills, see above) and the stream is
+ * unbuffered, so no stdio buffer is allocated either and *length is current
+ * after every operation without a flush.
+ *
+ * The mode is honored as for ccstreams_fmemopen(...): "w" modes empty the
+ * buffer, "a" modes write at the end and "a" starts positioned there. *buf
+ * must not be NULL (unless capacity is 0). As with ccstreams_fmemopen(...) no
+ * null byte is stored.
+ *
+ * Opening the stream still allocates its state and (inside fopencookie(...))
+ * the FILE itself. On a hot path open the stream once and point it at each
+ * new buffer with ccstreams_buf_reset(...), which doesn't allocate.
+ *
+ * Returns the stream, or NULL on error (EINVAL if *length is larger than
+ * capacity).
+ */
+FILE *
+ccstreams_fbufopen(char **buf, size_t capacity, size_t *length, const char *mode,
+                   enum ccstreams_buf_overflow overflow);
+
+/* Point an open stream returned by ccstreams_fbufopen(...) at another
+ * buffer, as if it had been closed and opened again on buf, capacity and
+ * length with the same mode and overflow handling. Nothing is allocated.
+ *
+ * The old buffer is left to the caller as on close (including a spilled
+ * one, which the caller frees). The error and end-of-file indicators are
+ * cleared.
+ *
+ * Returns 0 on success and -1 on error (EINVAL if stream isn't a buf stream
+ * or *length is larger than capacity). On error the stream stays on the old
+ * buffer.
+ */
+int
+ccstreams_buf_reset(FILE *stream, char **buf, size_t capacity, size_t *length);
+
+#endif /* CCSTREAMS_BUF_H */
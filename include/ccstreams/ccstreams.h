@@ -19,8 +19,19 @@
 #ifndef CCSTREAMS_H
 #define CCSTREAMS_H 1
 
+#include <ccstreams/alloc.h>
+#include <ccstreams/buf.h>
 #include <ccstreams/copy.h>
+#include <ccstreams/fdv.h>
+#include <ccstreams/map.h>
 #include <ccstreams/mem.h>
+#include <ccstreams/memfd.h>
+#include <ccstreams/peek.h>
+#include <ccstreams/pipe.h>
+#include <ccstreams/ring.h>
+#include <ccstreams/spool.h>
 #include <ccstreams/str.h>
+#include <ccstreams/tee.h>
+#include <ccstreams/writev.h>
 
 #endif /* CCSTREAMS_H */
@@ -22,6 +22,9 @@
 #include <stdio.h>
 
 /* Copy data from the input stream to the output stream. 
+ *
+ * The chunk size starts at the preferred I/O size of the streams and is
+ * grown while doing so improves throughput (see ccstreams_copy_with).
  *
  * bytes will be set to the total number of bytes written.
  * 
@@ -30,6 +33,24 @@
 int
 ccstreams_copy(FILE *from, FILE *to, size_t *bytes);
 
+/* Copy data from the input stream to the output stream through the given
+ * buffer of size bytes. The buffer can be reused across copies to avoid
+ * allocating one each time.
+ *
+ * If buffer is NULL one is allocated (and freed) as needed, up to size bytes.
+ * If size is also 0 a default limit of a few megabytes is used.
+ *
+ * The chunk size starts at the larger of 64KiB and the preferred I/O size of
+ * the streams (the block size of files or the capacity of pipes) and is
+ * doubled while doing so improves throughput, but never beyond size.
+ *
+ * bytes will be set to the total number of bytes written.
+ *
+ * Returns 0 on success and -1 on error.
+ */
+int
+ccstreams_copy_with(FILE *from, FILE *to, size_t *bytes, char *buffer, size_t size);
+
 /* Copy data from the input stream to the output stream in chunks of the given
  * size.
  *
@@ -40,4 +61,35 @@ ccstreams_copy(FILE *from, FILE *to, size_t *bytes);
 int
 ccstreams_copy_by(FILE *from, FILE *to, size_t *bytes, size_t chunk);
 
+/* Copy data from the input stream to the output stream in chunks of the given
+ * size, reading and writing concurrently. The calling thread reads into a
+ * small ring of chunks while a second thread writes them out, so a slow
+ * source and a slow destination overlap rather than take turns.
+ *
+ * Neither stream may be used by another thread during the copy.
+ *
+ * bytes will be set to the total number of bytes written.
+ *
+ * Returns 0 on success and -1 on error.
+ */
+int
+ccstreams_copy_async(FILE *from, FILE *to, size_t *bytes, size_t chunk);
+
+/* Copy data from the input stream to each of the n output streams in to,
+ * reading the input only once. The calling thread reads chunks of the given
+ * size into a small ring shared by one writer thread per output, each
+ * writing at its own pace. A chunk is only reused once every writer is done
+ * with it, so the slowest output sets the pace and memory stays bounded.
+ *
+ * An output that fails is dropped while the others carry on. None of the
+ * streams may be used by another thread during the copy.
+ *
+ * bytes[i] will be set to the number of bytes written to to[i].
+ *
+ * Returns 0 on success and -1 on error (the first error, for the input or
+ * any output).
+ */
+int
+ccstreams_copy_multi(FILE *from, FILE **to, size_t n, size_t *bytes, size_t chunk);
+
 #endif /* CCSTREAMS_COPY_H */
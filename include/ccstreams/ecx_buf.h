@@ -0,0 +1,31 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ECX_CCSTREAMS_BUF_H
+#define ECX_CCSTREAMS_BUF_H 1
+
+#include <ccstreams/buf.h>
+
+FILE *
+ecx_ccstreams_fbufopen(char **buf, size_t capacity, size_t *length, const char *mode,
+                       enum ccstreams_buf_overflow overflow);
+
+void
+ecx_ccstreams_buf_reset(FILE *stream, char **buf, size_t capacity, size_t *length);
+
+#endif /* ECX_CCSTREAMS_BUF_H */
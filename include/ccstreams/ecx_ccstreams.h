@@ -19,8 +19,18 @@
 #ifndef ECX_CCSTREAMS_H
 #define ECX_CCSTREAMS_H 1
 
+#include <ccstreams/ecx_buf.h>
 #include <ccstreams/ecx_copy.h>
+#include <ccstreams/ecx_fdv.h>
+#include <ccstreams/ecx_map.h>
 #include <ccstreams/ecx_mem.h>
+#include <ccstreams/ecx_memfd.h>
+#include <ccstreams/ecx_peek.h>
+#include <ccstreams/ecx_pipe.h>
+#include <ccstreams/ecx_ring.h>
+#include <ccstreams/ecx_spool.h>
 #include <ccstreams/ecx_str.h>
+#include <ccstreams/ecx_tee.h>
+#include <ccstreams/ecx_writev.h>
 
 #endif /* ECX_CCSTREAMS_H */
@@ -28,6 +28,14 @@
 void
 ecx_ccstreams_copy(FILE *from, FILE *to, size_t *bytes);
 
+/* Copy data from the input stream to the output stream through the given
+ * buffer of size bytes (see ccstreams_copy_with).
+ *
+ * bytes will be set to the total number of bytes written.
+ */
+void
+ecx_ccstreams_copy_with(FILE *from, FILE *to, size_t *bytes, char *buffer, size_t size);
+
 /* Copy data from the input stream to the output stream in chunks of the given
  * size.
  *
@@ -36,5 +44,20 @@ ecx_ccstreams_copy(FILE *from, FILE *to, size_t *bytes);
 void
 ecx_ccstreams_copy_by(FILE *from, FILE *to, size_t *bytes, size_t chunk);
 
+/* Copy data from the input stream to the output stream in chunks of the given
+ * size, reading and writing concurrently (see ccstreams_copy_async).
+ *
+ * bytes will be set to the total number of bytes written.
+ */
+void
+ecx_ccstreams_copy_async(FILE *from, FILE *to, size_t *bytes, size_t chunk);
+
+/* Copy data from the input stream to each of the n output streams, reading
+ * the input once (see ccstreams_copy_multi).
+ *
+ * bytes[i] will be set to the number of bytes written to to[i].
+ */
+void
+ecx_ccstreams_copy_multi(FILE *from, FILE **to, size_t n, size_t *bytes, size_t chunk);
 
 #endif /* ECX_CCSTREAMS_COPY_H */
@@ -24,4 +24,23 @@
 FILE *
 ecx_ccstreams_fmemopen(char **ptr, size_t *size, const char *mode);
 
+FILE *
+ecx_ccstreams_fmemopen_options(char **ptr, size_t *size, const char *mode,
+                               const struct ccstreams_mem_options *options);
+
+void
+ecx_ccstreams_mem_reserve(FILE *stream, size_t n, char **out);
+
+void
+ecx_ccstreams_mem_commit(FILE *stream, size_t used);
+
+void
+ecx_ccstreams_mem_reset(FILE *stream, char **ptr, size_t *size);
+
+void
+ecx_ccstreams_mem_iov(FILE *stream, struct iovec *iov, size_t *count);
+
+void
+ecx_ccstreams_mem_flatten(FILE *stream);
+
 #endif /* ECX_CCSTREAMS_MEM_H */
@@ -0,0 +1,30 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ECX_CCSTREAMS_RING_H
+#define ECX_CCSTREAMS_RING_H 1
+
+#include <ccstreams/ring.h>
+
+FILE *
+ecx_ccstreams_fringopen(size_t capacity, const char *mode);
+
+void
+ecx_ccstreams_ring_snapshot(FILE *stream, struct iovec segments[2]);
+
+#endif /* ECX_CCSTREAMS_RING_H */
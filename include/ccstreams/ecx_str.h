@@ -24,4 +24,11 @@
 FILE *
 ecx_ccstreams_fstropen(char **str, const char *mode);
 
+FILE *
+ecx_ccstreams_fstropen_options(char **str, const char *mode,
+                               const struct ccstreams_str_options *options);
+
+void
+ecx_ccstreams_str_reset(FILE *stream, char **str);
+
 #endif /* ECX_CCSTREAMS_STR_H */
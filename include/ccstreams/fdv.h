@@ -0,0 +1,68 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_FDV_H
+#define CCSTREAMS_FDV_H 1
+
+#include <stdio.h>
+
+/* Options for ccstreams_fdvopen(...).
+ *
+ * bytes:    Output is sent once this many bytes are pending. 0 selects the
+ *           default (CCSTREAMS_FDV_BYTES).
+ *
+ * segments: Output is sent once it is made up of this many segments. 0 (or
+ *           more than the system allows in one writev(...), IOV_MAX) selects
+ *           IOV_MAX.
+ */
+struct ccstreams_fdv_options {
+  size_t bytes;
+  size_t segments;
+};
+
+#define CCSTREAMS_FDV_BYTES (1024 * 1024)
+
+/* Create a write-only stream on the file descriptor fd that batches output
+ * and sends it with a single writev(...) when enough has built up (see
+ * above), on ccstreams_fdv_flush(...) and on close, instead of a write(...)
+ * per filled stdio buffer.
+ *
+ * Output is copied once, into chunks the stream keeps and reuses (the stream
+ * is unbuffered as far as stdio is concerned). Writes of a chunk (64 KiB) or
+ * more aren't copied: they go out straight away along with what is pending,
+ * in the same writev(...).
+ *
+ * fflush(...) doesn't reach fd (stdio has no way to pass it on), use
+ * ccstreams_fdv_flush(...). Closing the stream sends what is pending and
+ * closes fd, as for fdopen(...). options may be NULL to use the defaults.
+ *
+ * Returns the stream, or NULL on error.
+ */
+FILE *
+ccstreams_fdvopen(int fd, const struct ccstreams_fdv_options *options);
+
+/* Send all output pending on a stream returned by ccstreams_fdvopen(...).
+ * On error what couldn't be sent stays pending.
+ *
+ * Returns 0 on success and -1 on error (EINVAL if stream isn't an fdv
+ * stream).
+ */
+int
+ccstreams_fdv_flush(FILE *stream);
+
+#endif /* CCSTREAMS_FDV_H */
@@ -0,0 +1,52 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_MAP_H
+#define CCSTREAMS_MAP_H 1
+
+#include <stdio.h>
+
+/* Expect the file to be read in no particular order (MADV_RANDOM): the
+ * kernel turns off readahead and only reads the pages that are touched. By
+ * default access is taken to be sequential (MADV_SEQUENTIAL).
+ */
+#define CCSTREAMS_MAP_RANDOM 0x1
+
+/* Start reading the whole file into the page cache as it is opened. */
+#define CCSTREAMS_MAP_WILLNEED 0x2
+
+/* Open the file at path read-only as a stream served from a mapping of the
+ * file (mmap(...)) instead of read(...) calls: after the open no system calls
+ * are made and the data is read straight out of the page cache. Combined with
+ * ccstreams_peek(...) and ccstreams_consume(...) the data needn't be copied
+ * at all.
+ *
+ * mode must be a reading mode ("r" or "rb"). flags is a bitwise OR of the
+ * CCSTREAMS_MAP_* flags above (or 0).
+ *
+ * The stream sees the file as it was when opened. If the file is truncated
+ * while the stream is open, reading the lost part raises SIGBUS, so this is
+ * meant for files that don't change (static assets and the like).
+ *
+ * Returns the stream, or NULL on error (EINVAL if mode allows writing or the
+ * path isn't a regular file).
+ */
+FILE *
+ccstreams_fmapopen(const char *path, const char *mode, int flags);
+
+#endif /* CCSTREAMS_MAP_H */
@@ -20,11 +20,15 @@
 #define CCSTREAMS_MEM_H 1
 
 #include <stdio.h>
+#include <sys/uio.h>
+
+#include <ccstreams/alloc.h>
 
 /* Create a stream from a memory buffer. If *ptr is NULL, then an empty (zero
  * sized) buffer will be allocated, otherwise the existing data is used. The
  * caller should free the buffer after the stream is closed. The buffer will
- * be grown via calls to realloc(...) when writing past the end of the buffer.
+ * be grown via calls to realloc(...) when writing past the end of the buffer
+ * (see ccstreams_fmemopen_options(...) for how the capacity is managed).
  * Output to the stream will invalidate the contents of ptr and size (as well
  * as *ptr and *size) until after a flush or close.
  *
@@ -49,4 +53,189 @@
 FILE *
 ccstreams_fmemopen(char **ptr, size_t *size, const char *mode);
 
+/* Options for ccstreams_fmemopen_options(...).
+ *
+ * capacity: The number of bytes to reserve for the buffer when the stream is
+ *           opened for writing. This is only a hint and avoids growing the
+ *           buffer repeatedly when the final size is roughly known. 0 means
+ *           no hint.
+ *
+ * growth:   The factor by which the capacity of the buffer is multiplied when
+ *           a write doesn't fit. Values <= 1 select the default
+ *           (CCSTREAMS_MEM_GROWTH).
+ *
+ * flags:    A bitwise OR of the CCSTREAMS_MEM_* flags below.
+ *
+ * allocator: Used for the buffer (in place of malloc(...), realloc(...) and
+ *            free(...)) and for the state of the stream. An existing buffer
+ *            must have come from it, and the caller frees the buffer through
+ *            it after the stream is closed. NULL selects malloc(...) and
+ *            friends. For buffers of many megabytes or more,
+ *            &ccstreams_allocator_mmap grows the buffer by remapping it
+ *            rather than copying it (&ccstreams_allocator_mmap_huge also
+ *            asks for huge pages).
+ *
+ * chunk:    The size of the chunks of a CCSTREAMS_MEM_CHUNKED stream. 0
+ *           selects the default (1 MiB).
+ *
+ * allocated: If not NULL, kept up to date with the size of the allocation
+ *            behind *ptr. This is the size to give the allocator's free(...)
+ *            and may be more than *size: while the stream is open, for a
+ *            buffer taken before ccstreams_mem_reset(...) (read it along
+ *            with the buffer) and if shrinking the buffer on close failed.
+ *
+ * chunks, chunk_count: Where a CCSTREAMS_MEM_CHUNKED stream hands back the
+ *            chunks after the first when it is closed (required for such a
+ *            stream, ignored otherwise). See CCSTREAMS_MEM_CHUNKED.
+ */
+struct ccstreams_mem_options {
+  size_t capacity;
+  double growth;
+  int flags;
+  const struct ccstreams_allocator *allocator;
+  size_t chunk;
+  size_t *allocated;
+  struct iovec **chunks;
+  size_t *chunk_count;
+};
+
+#define CCSTREAMS_MEM_GROWTH 2.0
+
+/* Use the space reserved after the end of the buffer as the stdio buffer of
+ * the stream. Output through stdio (fprintf, fwrite, etc) then lands in the
+ * buffer itself and a flush only has to account for it, rather than copying
+ * it out of the stdio buffer. The stdio buffer follows the end of the buffer
+ * as it grows.
+ *
+ * Only applies to streams opened for writing and only where the C library
+ * permits it (glibc). Otherwise the flag is ignored. Calling setvbuf(...) on
+ * the stream turns it off.
+ */
+#define CCSTREAMS_MEM_DIRECT 0x1
+
+/* Keep the data in a list of fixed size chunks rather than one buffer. The
+ * buffer is never reallocated (or copied) as it grows, so writing a large
+ * amount costs a single pass over it with at most one chunk to spare. The
+ * chunks are gathered into *ptr by ccstreams_mem_flatten(...); until then
+ * *ptr only holds the first chunk and the data can be reached with
+ * ccstreams_mem_iov(...).
+ *
+ * The chunks options must be given. When the stream is closed *ptr and
+ * *size are left with the first chunk (the data that was in *ptr after
+ * opening or after the last ccstreams_mem_flatten(...), including any
+ * changes written over it since) and the rest of the data is handed back as
+ * *chunk_count segments in *chunks (NULL if there are none). The segments
+ * and the array are the caller's: each is freed through the allocator with
+ * its iov_len, and the array with *chunk_count * sizeof(struct iovec). Data
+ * that was already sent out with ccstreams_mem_iov(...) is then never
+ * copied. With CCSTREAMS_MEM_FLATTEN the chunks are gathered into *ptr
+ * instead.
+ *
+ * ccstreams_fmemopen_options(...) fails with EINVAL if the chunks options
+ * are missing. If the chunks can't be handed back on close (the array can't
+ * be allocated), fclose(...) returns EOF and they are left allocated rather
+ * than freed.
+ *
+ * ccstreams_peek(...) only sees to the end of the current chunk. capacity,
+ * growth and CCSTREAMS_MEM_DIRECT are ignored, and ccstreams_mem_reserve(...)
+ * and ccstreams_mem_reset(...) aren't supported (EINVAL).
+ */
+#define CCSTREAMS_MEM_CHUNKED 0x2
+
+/* Gather the chunks of a CCSTREAMS_MEM_CHUNKED stream into *ptr when it is
+ * closed, as ccstreams_mem_flatten(...) does. This needs a buffer for all of
+ * the data; if it can't be allocated, fclose(...) returns EOF and the chunks
+ * are handed back as they would be without this flag.
+ */
+#define CCSTREAMS_MEM_FLATTEN 0x4
+
+/* Create a stream from a memory buffer as per ccstreams_fmemopen(...) using
+ * the given options. options may be NULL to use the defaults.
+ *
+ * The buffer is grown geometrically, so while the stream is open (and after
+ * a flush) the allocation behind *ptr may be larger than *size. The buffer is
+ * shrunk to exactly *size bytes when the stream is closed, unless that fails
+ * (the allocated option then has its size).
+ */
+FILE *
+ccstreams_fmemopen_options(char **ptr, size_t *size, const char *mode,
+                           const struct ccstreams_mem_options *options);
+
+/* Reserve n bytes of writable space in the buffer of a stream returned by
+ * ccstreams_fmemopen(...) at the position the next write would go (the end
+ * of the buffer in append mode). *out is set to the start of the space. The
+ * data can then be produced in place and made part of the buffer with
+ * ccstreams_mem_commit(...), rather than being staged elsewhere and copied
+ * in with fwrite(...).
+ *
+ * Pending output is flushed first. *out is only valid until the next
+ * operation on the stream, which must be the commit.
+ *
+ * Returns 0 on success and -1 on error (EINVAL if stream isn't a mem
+ * stream, EBADF if it isn't open for writing).
+ */
+int
+ccstreams_mem_reserve(FILE *stream, size_t n, char **out);
+
+/* Complete a ccstreams_mem_reserve(...): the first used bytes of the
+ * reserved space become part of the buffer (growing *size as needed) and the
+ * stream is positioned after them (in append mode the position is left
+ * alone, as for any write). used may be 0 to abandon the reservation.
+ *
+ * Returns 0 on success and -1 on error (EINVAL if used is larger than the
+ * reservation).
+ */
+int
+ccstreams_mem_commit(FILE *stream, size_t used);
+
+/* Point an open stream returned by ccstreams_fmemopen(...) at another
+ * buffer, as if it had been closed and opened again on ptr and size with the
+ * same mode and options. This avoids allocating a new stream (and its stdio
+ * buffer) for each buffer when many are filled or read in turn.
+ *
+ * Pending output is flushed to the old buffer, which is then shrunk to fit
+ * and left to the caller (if it can't be shrunk, the reset fails). The error and end-of-file indicators are cleared.
+ *
+ * The same ptr and size may be given again, in which case the stream carries
+ * on with the same buffer as if reopened on it. To keep the old buffer and
+ * reuse the variables instead, flush the stream, take the buffer and set
+ * *ptr to NULL before the reset. A buffer taken like that is left as it was
+ * after the flush, so may be larger than its size: take the allocated option
+ * along with it to free it.
+ *
+ * Returns 0 on success and -1 on error (EINVAL if stream isn't a mem
+ * stream). On error the stream stays on the old buffer, which is put back in
+ * the old *ptr if it was taken.
+ */
+int
+ccstreams_mem_reset(FILE *stream, char **ptr, size_t *size);
+
+/* Describe the data of a stream returned by ccstreams_fmemopen(...) as up
+ * to *count segments in iov (one for a plain stream, one per chunk for a
+ * CCSTREAMS_MEM_CHUNKED stream). *count is set to the number of segments the
+ * whole of the data takes, which may be more than were filled in. The
+ * segments can be handed to writev(...) as is.
+ *
+ * Pending output is flushed first. The segments are only valid until the
+ * next operation on the stream that may write to it.
+ *
+ * Returns 0 on success and -1 on error (EINVAL if stream isn't a mem
+ * stream).
+ */
+int
+ccstreams_mem_iov(FILE *stream, struct iovec *iov, size_t *count);
+
+/* Gather the data of a stream returned by ccstreams_fmemopen(...) into a
+ * single buffer at *ptr (of *size bytes) while leaving the stream open. This
+ * is already the case unless the stream is CCSTREAMS_MEM_CHUNKED.
+ *
+ * Pending output is flushed first. Later writes may split the buffer up
+ * again.
+ *
+ * Returns 0 on success and -1 on error (EINVAL if stream isn't a mem
+ * stream).
+ */
+int
+ccstreams_mem_flatten(FILE *stream);
+
 #endif /* CCSTREAMS_MEM_H */
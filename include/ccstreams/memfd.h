@@ -0,0 +1,49 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_MEMFD_H
+#define CCSTREAMS_MEMFD_H 1
+
+#include <stdio.h>
+
+/* Create a stream over an anonymous memory file (memfd_create(...)) so the
+ * data can be handed to another process as a descriptor (over a unix socket
+ * with SCM_RIGHTS, or across fork(...)) instead of being copied through a
+ * pipe. The data is written straight into a shared mapping of the file.
+ *
+ * If *fd is -1 a new file is created and *fd is set to it; mode must then be
+ * a writing mode ("w", "w+", "a" or "a+"). When the stream is closed the
+ * file is cut to the size of the data and sealed against any change
+ * (F_SEAL_WRITE, F_SEAL_GROW, F_SEAL_SHRINK and F_SEAL_SEAL), so the
+ * receiver can map and read it without checking it for changes.
+ *
+ * Otherwise *fd is an existing file (e.g. one received from another
+ * process) to read: mode must be "r" and the stream reads from a mapping of
+ * it.
+ *
+ * The descriptor belongs to the caller in both cases and stays open after
+ * the stream is closed. The stream supports ccstreams_peek(...).
+ *
+ * Returns the stream, or NULL on error (EINVAL if mode doesn't suit *fd,
+ * ENOSYS if memfd_create(...) isn't available). On error a file created
+ * here is closed again and *fd is left at -1.
+ */
+FILE *
+ccstreams_fmemfdopen(int *fd, const char *mode);
+
+#endif /* CCSTREAMS_MEMFD_H */
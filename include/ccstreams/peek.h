@@ -0,0 +1,50 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_PEEK_H
+#define CCSTREAMS_PEEK_H 1
+
+#include <stdio.h>
+
+/* Look at the data of a mem, memfd, str, buf or map stream at the current
+ * position without copying it. *data is set to the data in the backing store
+ * (*ptr, *str, *buf or the mapping of the file) at the position of the stream and
+ * *avail to the number of bytes from there to the end. For a
+ * CCSTREAMS_MEM_CHUNKED stream the data is that of the current chunk, so
+ * consuming it and peeking again moves on to the next.
+ *
+ * Pending output is flushed first. *data is only valid until the next
+ * operation on the stream that may write to it.
+ *
+ * Returns 0 on success and -1 on error (EINVAL if stream isn't a mem, memfd,
+ * str, buf or map stream).
+ */
+int
+ccstreams_peek(FILE *stream, const char **data, size_t *avail);
+
+/* Advance the position of a mem, memfd, str, buf or map stream by n bytes,
+ * typically after scanning them with ccstreams_peek(...). This is a seek, so
+ * it is cheapest to consume as much as possible at once.
+ *
+ * Returns 0 on success and -1 on error (EINVAL if stream isn't a mem, memfd,
+ * str, buf or map stream or n is past the end).
+ */
+int
+ccstreams_consume(FILE *stream, size_t n);
+
+#endif /* CCSTREAMS_PEEK_H */
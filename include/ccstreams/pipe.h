@@ -0,0 +1,56 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_PIPE_H
+#define CCSTREAMS_PIPE_H 1
+
+#include <stdio.h>
+
+#define CCSTREAMS_PIPE_CAPACITY (64 * 1024)
+
+/* Don't wait for data or space (see ccstreams_fpipeopen(...)). */
+#define CCSTREAMS_PIPE_NONBLOCK 0x1
+
+/* Create a pipe between two threads of the process: bytes written to
+ * *writer can be read from *reader. The bytes pass through a ring buffer of
+ * capacity bytes (rounded up to a power of two, 0 selects
+ * CCSTREAMS_PIPE_CAPACITY) that the two ends share without locks, so moving
+ * data takes no system calls unless one end has to wait for the other.
+ *
+ * There must be one thread writing and one thread reading (the two ends are
+ * not safe to use from several threads each, as for any FILE used with the
+ * unlocked stdio functions). The ends are closed separately: once the writer
+ * is closed the reader sees end-of-file after the remaining data, and once
+ * the reader is closed writes fail with EPIPE.
+ *
+ * By default a read waits for data and a write waits for space (on a futex).
+ * With CCSTREAMS_PIPE_NONBLOCK they fail with EAGAIN instead and set the
+ * error indicator of the stream (clearerr(...) before trying again). The
+ * writer is then unbuffered, so fwrite(...) reports how much of a partial
+ * write went in and nothing is held back in stdio.
+ *
+ * Output is only seen by the reader once it leaves the stdio buffer of the
+ * writer: call fflush(...) (or make the writer line buffered) where latency
+ * matters.
+ *
+ * Returns 0 on success and -1 on error.
+ */
+int
+ccstreams_fpipeopen(FILE **reader, FILE **writer, size_t capacity, int flags);
+
+#endif /* CCSTREAMS_PIPE_H */
@@ -0,0 +1,58 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_RING_H
+#define CCSTREAMS_RING_H 1
+
+#include <stdio.h>
+#include <sys/uio.h>
+
+/* Create a stream over a circular buffer of capacity bytes, e.g. to keep the
+ * most recent part of a log in memory. Output always goes to the end; once
+ * the buffer is full each write overwrites the oldest data, so a write costs
+ * the same however much has been written before it.
+ *
+ * Reading takes data from the oldest byte still held onwards and consumes
+ * it, as for a pipe (data overwritten before it was read is skipped). The
+ * stream can't seek. mode is as for fopen(...) and must allow writing ("w",
+ * "w+", "a" or "a+"); "+" also allows reading.
+ *
+ * Returns the stream, or NULL on error (EINVAL if capacity is 0 or mode
+ * doesn't allow writing).
+ */
+FILE *
+ccstreams_fringopen(size_t capacity, const char *mode);
+
+/* Describe the data held by a stream returned by ccstreams_fringopen(...)
+ * (oldest first) without copying or consuming it. The buffer wraps around,
+ * so the data takes up to two segments: segments[0] is set to the older
+ * part and segments[1] to the rest (with a length of 0 when it doesn't
+ * wrap). They can be handed to writev(...) as is, e.g. to dump a log after
+ * a crash.
+ *
+ * Pending output is flushed first. Data the stream has already read into
+ * its stdio buffer isn't included. The segments are only valid until the
+ * next operation on the stream.
+ *
+ * Returns 0 on success and -1 on error (EINVAL if stream isn't a ring
+ * stream).
+ */
+int
+ccstreams_ring_snapshot(FILE *stream, struct iovec segments[2]);
+
+#endif /* CCSTREAMS_RING_H */
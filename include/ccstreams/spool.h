@@ -0,0 +1,78 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_SPOOL_H
+#define CCSTREAMS_SPOOL_H 1
+
+#include <stdio.h>
+
+#include <ccstreams/alloc.h>
+
+/* Options for ccstreams_fspoolopen(...).
+ *
+ * threshold: The number of bytes kept in memory. A write that would take
+ *            the data past it moves the data to a temporary file and the
+ *            stream carries on there. 0 selects the default
+ *            (CCSTREAMS_SPOOL_THRESHOLD).
+ *
+ * directory: Where the temporary file is created. NULL selects $TMPDIR (or
+ *            /tmp when it isn't set). The string must remain valid while
+ *            the stream is open.
+ *
+ * allocator: Used for the data while it is in memory and for the state of
+ *            the stream. NULL selects malloc(...) and friends.
+ */
+struct ccstreams_spool_options {
+  size_t threshold;
+  const char *directory;
+  const struct ccstreams_allocator *allocator;
+};
+
+#define CCSTREAMS_SPOOL_THRESHOLD (1024 * 1024)
+
+/* Create an empty stream that holds its data in memory until it grows past
+ * a threshold and in an anonymous temporary file after that (O_TMPFILE
+ * where the file system supports it, otherwise a file that is unlinked as
+ * soon as it is created). Small data never touches the disk and large data
+ * never has to fit in memory.
+ *
+ * Either way the stream behaves as one returned by ccstreams_fmemopen(...)
+ * on an empty buffer: it can be read back after seeking, "a" modes write at
+ * the end and seeking past the end fails. The data is gone when the stream
+ * is closed. options may be NULL to use the defaults.
+ *
+ * Returns the stream, or NULL on error.
+ */
+FILE *
+ccstreams_fspoolopen(const char *mode, const struct ccstreams_spool_options *options);
+
+/* Get the temporary file of a stream returned by ccstreams_fspoolopen(...),
+ * e.g. to hand the data to sendfile(...). *fd is set to the descriptor of
+ * the file, or to -1 if the data is still in memory. The descriptor belongs
+ * to the stream and is closed with it; its file offset is not the position
+ * of the stream.
+ *
+ * Pending output is flushed first.
+ *
+ * Returns 0 on success and -1 on error (EINVAL if stream isn't a spool
+ * stream).
+ */
+int
+ccstreams_spool_fd(FILE *stream, int *fd);
+
+#endif /* CCSTREAMS_SPOOL_H */
@@ -21,6 +21,8 @@
 
 #include <stdio.h>
 
+#include <ccstreams/alloc.h>
+
 /* Create a FILE stream from a C string. The mode will be honored as per
  * fopen(...). Please remember to following nuances:
  *
@@ -38,8 +40,9 @@
  *
  * The caller should free *str after closing the stream.
  *
- * The string will be grown/shrunk via calls to realloc(...). A trailing NULL
- * byte will be maintained.
+ * The string will be grown via calls to realloc(...) (geometrically, see
+ * ccstreams_fstropen_options(...)) and shrunk to fit when the stream is
+ * closed. A trailing NULL byte will be maintained.
  *
  * Explicitly writing a NULL byte will truncate the string.
  *
@@ -50,4 +53,83 @@
 FILE *
 ccstreams_fstropen(char **str, const char *mode);
 
+/* Options for ccstreams_fstropen_options(...).
+ *
+ * length:   If not NULL and *str is not NULL, *length is used as the length
+ *           of *str instead of scanning it with strlen(...). It is updated
+ *           with the length of the string after every flush and on close.
+ *
+ * capacity: If not NULL and *str is not NULL, *capacity is the number of
+ *           bytes allocated for *str. It is updated with the size of the
+ *           allocation after every flush and on close. When the capacity is
+ *           tracked by the caller the string is not shrunk on close (so that
+ *           it can be reopened and appended to without reallocating).
+ *
+ * growth:   The factor by which the capacity of the string is multiplied when
+ *           a write doesn't fit. Values <= 1 select the default
+ *           (CCSTREAMS_STR_GROWTH).
+ *
+ * flags:    A bitwise OR of the CCSTREAMS_STR_* flags below.
+ *
+ * allocator: Used for the string (in place of malloc(...), realloc(...) and
+ *           free(...)) and for the state of the stream. An existing string
+ *           must have come from it, and the caller frees the string through
+ *           it after the stream is closed. NULL selects malloc(...) and
+ *           friends.
+ *
+ * Keeping length and capacity with the string makes reopening it (e.g. in
+ * "a" mode) a constant time operation.
+ */
+struct ccstreams_str_options {
+  size_t *length;
+  size_t *capacity;
+  double growth;
+  const struct ccstreams_allocator *allocator;
+  int flags;
+};
+
+#define CCSTREAMS_STR_GROWTH 2.0
+
+/* Defer allocating a missing string (see ccstreams_fstropen(...)) until the
+ * first write reaches the stream (when stdio flushes), which then allocates
+ * it at the size it needs, or until the stream is closed. This saves growing
+ * the string from a single byte on the first flush, and allocating at all
+ * for a stream that is reset (see ccstreams_str_reset(...)) without being
+ * written to.
+ *
+ * Until then *str is left NULL.
+ */
+#define CCSTREAMS_STR_LAZY 0x1
+
+/* Create a FILE stream from a C string as per ccstreams_fstropen(...) using
+ * the given options. options may be NULL to use the defaults.
+ */
+FILE *
+ccstreams_fstropen_options(char **str, const char *mode,
+                           const struct ccstreams_str_options *options);
+
+/* Point an open stream returned by ccstreams_fstropen(...) at another
+ * string, as if it had been closed and opened again on str with the same
+ * mode and options. This avoids allocating a new stream (and its stdio
+ * buffer) for each string when many are filled or read in turn.
+ *
+ * Pending output is flushed to the old string, which is then left to the
+ * caller as on close. If the stream was opened with length or capacity
+ * options, they are reported for the old string and then read as the length
+ * and capacity of the new one (so update them in between if *str changes).
+ * The error and end-of-file indicators are cleared.
+ *
+ * The same str may be given again, in which case the stream carries on with
+ * the same string as if reopened on it. To keep the old string and reuse the
+ * variable instead, flush the stream, take the string and set *str to NULL
+ * before the reset. A string taken like that is left as it was after the
+ * flush (so may be larger than it needs to be).
+ *
+ * Returns 0 on success and -1 on error (EINVAL if stream isn't a str
+ * stream). On error the stream stays on the old string, which is put back in
+ * the old *str if it was taken.
+ */
+int
+ccstreams_str_reset(FILE *stream, char **str);
+
 #endif /* CCSTREAMS_STR_H */
@@ -0,0 +1,43 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_TEE_H
+#define CCSTREAMS_TEE_H 1
+
+#include <stdio.h>
+
+/* Create a write-only stream that duplicates its output to each of the n
+ * streams in targets (in order), so a record can be formatted once and
+ * written to several places.
+ *
+ * Output to targets that are mem or str streams is copied straight into
+ * their buffers (as by ccstreams_writev(...)) rather than going through
+ * their stdio buffers. Other targets get an fwrite(...).
+ *
+ * The targets array is copied, but the streams must stay open until the tee
+ * is closed. Closing the tee flushes the targets and leaves them open.
+ *
+ * A write fails if it fails for any target (the other targets may still have
+ * got it).
+ *
+ * Returns the stream, or NULL on error.
+ */
+FILE *
+ccstreams_fteeopen(FILE **targets, size_t n);
+
+#endif /* CCSTREAMS_TEE_H */
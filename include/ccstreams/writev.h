@@ -0,0 +1,41 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_WRITEV_H
+#define CCSTREAMS_WRITEV_H 1
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Write iovcnt segments to stream in order, as if by an fwrite(...) of each.
+ * For mem and str streams the buffer is grown once for the total and the
+ * segments are copied straight into it, rather than growing it (and going
+ * through the stdio buffer) segment by segment. Other streams get the
+ * fwrite(...) calls.
+ *
+ * Pending output is flushed first for mem and str streams.
+ *
+ * Returns the number of bytes written (the total of the segments) and -1 on
+ * error (EINVAL if iovcnt is negative, EBADF if the stream isn't open for
+ * writing). Some of the segments may have been written on error.
+ */
+ssize_t
+ccstreams_writev(FILE *stream, const struct iovec *iov, int iovcnt);
+
+#endif /* CCSTREAMS_WRITEV_H */
@@ -0,0 +1,166 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "alloc.h"
+
+/* Mappings from this size on are offered to transparent huge pages (by
+ * ccstreams_allocator_mmap_huge).
+ */
+#define MMAP_HUGE (2 * 1024 * 1024)
+
+/* The context of ccstreams_allocator_mmap_huge (its address is all that
+ * matters).
+ */
+static const int mmap_huge = 1;
+
+static
+void *
+default_alloc(void *context, size_t size)
+{
+  return malloc(size);
+}
+
+static
+void *
+default_grow(void *context, void *ptr, size_t old_size, size_t size)
+{
+  return realloc(ptr, size);
+}
+
+static
+void
+default_free(void *context, void *ptr, size_t size)
+{
+  free(ptr);
+}
+
+const struct ccstreams_allocator ccstreams_allocator_default = {
+  .alloc = default_alloc,
+  .grow = default_grow,
+  .free = default_free,
+  .context = NULL,
+};
+
+/* The length of the mapping behind an allocation of size bytes. Empty
+ * allocations still need an address of their own, so they take a page.
+ */
+static
+size_t
+mmap_length(size_t size)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+
+  if (size == 0) {
+    return page;
+  }
+
+  return (size + page - 1) & ~(page - 1);
+}
+
+static
+void
+mmap_advise(void *context, void *ptr, size_t length)
+{
+#if defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+  if (context == &mmap_huge && length >= MMAP_HUGE) {
+    /* Only a hint: without THP the pages are simply small. */
+    madvise(ptr, length, MADV_HUGEPAGE);
+  }
+#endif
+}
+
+static
+void *
+mmap_alloc(void *context, size_t size)
+{
+  size_t length = mmap_length(size);
+  void *ptr = NULL;
+
+  ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return NULL;
+  }
+
+  mmap_advise(context, ptr, length);
+
+  return ptr;
+}
+
+static
+void *
+mmap_grow(void *context, void *ptr, size_t old_size, size_t size)
+{
+  size_t old_length = mmap_length(old_size);
+  size_t length = mmap_length(size);
+  void *grown = NULL;
+
+  if (length == old_length) {
+    return ptr;
+  }
+
+#ifdef HAVE_MREMAP
+  /* The kernel moves the pages rather than copying the data. */
+  grown = mremap(ptr, old_length, length, MREMAP_MAYMOVE);
+  if (grown == MAP_FAILED) {
+    return NULL;
+  }
+#else
+  grown = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (grown == MAP_FAILED) {
+    return NULL;
+  }
+
+  memcpy(grown, ptr, old_length < length ? old_length : length);
+  munmap(ptr, old_length);
+#endif
+
+  if (length > old_length) {
+    mmap_advise(context, grown, length);
+  }
+
+  return grown;
+}
+
+static
+void
+mmap_free(void *context, void *ptr, size_t size)
+{
+  if (ptr == NULL) return;
+
+  munmap(ptr, mmap_length(size));
+}
+
+const struct ccstreams_allocator ccstreams_allocator_mmap = {
+  .alloc = mmap_alloc,
+  .grow = mmap_grow,
+  .free = mmap_free,
+  .context = NULL,
+};
+
+const struct ccstreams_allocator ccstreams_allocator_mmap_huge = {
+  .alloc = mmap_alloc,
+  .grow = mmap_grow,
+  .free = mmap_free,
+  .context = (void *)&mmap_huge,
+};
@@ -0,0 +1,401 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccstreams/buf.h>
+
+#include "mode.h"
+#include "stream.h"
+
+/* Factor by which a spilled buffer grows. */
+#define BUF_GROWTH 2
+
+struct buf_cookie {
+  struct ccstreams_stream stream;
+  char **buf;
+  size_t capacity;
+  size_t *length;
+  enum ccstreams_buf_overflow overflow;
+  off_t offset;
+  struct ccstreams_mode mode;
+  int spilled;
+};
+
+static
+int
+buf_cookie_init(struct buf_cookie *self, char **buf, const size_t capacity, size_t *length, const enum ccstreams_buf_overflow overflow, const struct ccstreams_mode *mode)
+{
+  assert(buf != NULL);
+  assert(length != NULL);
+  assert(*length <= capacity);
+
+  self->stream.file = NULL;
+  self->buf = buf;
+  self->capacity = capacity;
+  self->length = length;
+  self->overflow = overflow;
+  self->offset = 0;
+  self->mode = *mode;
+  self->spilled = 0;
+
+  return 0;
+}
+
+static
+void
+buf_cookie_fini(struct buf_cookie *self)
+{
+  if (self == NULL) return;
+
+  self->buf = NULL;
+  self->capacity = 0;
+  self->length = NULL;
+  self->overflow = 0;
+  self->offset = 0;
+  memset(&self->mode, 0, sizeof(self->mode));
+  self->spilled = 0;
+}
+
+/* Make room for needed bytes on the heap. The first spill copies the data
+ * out of the caller's buffer, after that the heap buffer is grown
+ * geometrically.
+ */
+static
+int
+buf_cookie_spill(struct buf_cookie *self, size_t needed)
+{
+  int status = 0;
+  char *heap = NULL;
+  size_t capacity = self->capacity < SIZE_MAX / BUF_GROWTH ? self->capacity * BUF_GROWTH : SIZE_MAX;
+
+  if (capacity < needed) {
+    capacity = needed;
+  }
+
+  if (self->spilled) {
+    heap = realloc(*self->buf, capacity);
+    if (heap == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+  }
+  else {
+    heap = malloc(capacity);
+    if (heap == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+
+    if (*self->length > 0) {
+      memcpy(heap, *self->buf, *self->length);
+    }
+  }
+
+  *self->buf = heap;
+  self->capacity = capacity;
+  self->spilled = 1;
+
+cleanup:
+  return status;
+}
+
+static
+ssize_t
+buf_read(void *cookie, char *buf, size_t size)
+{
+  struct buf_cookie *buf_cookie = cookie;
+
+  size_t bytes_read = *buf_cookie->length - buf_cookie->offset;
+
+  if (bytes_read > size) {
+    bytes_read = size;
+  }
+
+  memcpy(buf, *buf_cookie->buf + buf_cookie->offset, bytes_read);
+  buf_cookie->offset += bytes_read;
+
+  return bytes_read;
+}
+
+static
+ssize_t
+buf_write(void *cookie, const char *buf, size_t size)
+{
+  int status = 0;
+  struct buf_cookie *buf_cookie = cookie;
+
+  int append = buf_cookie->mode.append;
+  size_t start = append ? *buf_cookie->length : buf_cookie->offset;
+  size_t fits = size;
+
+  if (size > buf_cookie->capacity - start) {
+    switch (buf_cookie->overflow) {
+      case CCSTREAMS_BUF_TRUNCATE:
+        fits = buf_cookie->capacity - start;
+        break;
+      case CCSTREAMS_BUF_FAIL:
+        status = -1;
+        errno = ENOSPC;
+        goto cleanup;
+      case CCSTREAMS_BUF_SPILL:
+        if (size > SIZE_MAX - start) {
+          status = -1;
+          errno = EOVERFLOW;
+          goto cleanup;
+        }
+
+        status = buf_cookie_spill(buf_cookie, start + size);
+        if (status != 0) {
+          status = -1;
+          goto cleanup;
+        }
+        break;
+    }
+  }
+
+  memcpy(*buf_cookie->buf + start, buf, fits);
+
+  if (*buf_cookie->length < start + fits) {
+    *buf_cookie->length = start + fits;
+  }
+
+  if (!append) {
+    buf_cookie->offset = start + fits;
+  }
+
+cleanup:
+  /* Report failure as nothing written: glibc mishandles -1 from a cookie
+   * write on its unbuffered path, while a short write sets the error
+   * indicator as it should.
+   */
+  if (status != 0) {
+    return 0;
+  }
+
+  /* Truncated output counts as written, otherwise stdio flags an error. */
+  return size;
+}
+
+static
+int
+buf_seek(void *cookie, off64_t *offset, int whence)
+{
+  int status = 0;
+  struct buf_cookie *buf_cookie = cookie;
+  off_t new_offset = buf_cookie->offset;
+
+  switch (whence) {
+    case SEEK_SET:
+      new_offset = *offset;
+      break;
+    case SEEK_CUR:
+      new_offset += *offset;
+      break;
+    case SEEK_END:
+      new_offset = *buf_cookie->length + *offset;
+      break;
+  }
+
+  if (new_offset < 0 || *buf_cookie->length < (size_t)new_offset) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+cleanup:
+  if (status == 0) {
+    buf_cookie->offset = new_offset;
+    *offset = new_offset;
+  }
+
+  return status;
+}
+
+static
+void
+buf_peek(struct ccstreams_stream *stream, const char **data, size_t *avail)
+{
+  struct buf_cookie *buf_cookie = (struct buf_cookie *)stream;
+
+  *data = *buf_cookie->buf + buf_cookie->offset;
+  *avail = *buf_cookie->length - buf_cookie->offset;
+}
+
+static const struct ccstreams_stream_ops buf_stream_ops = {
+  .peek = buf_peek,
+};
+
+static
+int
+buf_close(void *cookie)
+{
+  int status = 0;
+  struct buf_cookie *buf_cookie = cookie;
+
+  ccstreams_stream_unregister(&buf_cookie->stream);
+  buf_cookie_fini(buf_cookie);
+  free(buf_cookie);
+
+  return status;
+}
+
+FILE *
+ccstreams_fbufopen(char **buf, size_t capacity, size_t *length, const char *mode,
+                   enum ccstreams_buf_overflow overflow)
+{
+  assert(buf != NULL);
+  assert(*buf != NULL || capacity == 0);
+  assert(length != NULL);
+
+  int status = 0;
+  FILE *stream = NULL;
+  struct buf_cookie *cookie = NULL;
+  cookie_io_functions_t buf_io_funcs = {
+    .read  = buf_read,
+    .write = buf_write,
+    .seek  = buf_seek,
+    .close = buf_close,
+  };
+  struct ccstreams_mode parsed;
+
+  ccstreams_mode_parse(&parsed, mode);
+
+  if (*length > capacity) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  if (parsed.truncate) {
+    *length = 0;
+  }
+
+  cookie = malloc(sizeof(*cookie));
+  if (cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = buf_cookie_init(cookie, buf, capacity, length, overflow, &parsed);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  stream = fopencookie(cookie, mode, buf_io_funcs);
+  if (stream == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  ccstreams_stream_register(&cookie->stream, stream, CCSTREAMS_STREAM_BUF, &buf_stream_ops);
+
+  /* The data goes straight to the buffer: no stdio buffer to allocate and
+   * nothing pending to flush.
+   */
+  status = setvbuf(stream, NULL, _IONBF, 0);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (parsed.end) {
+    status = fseek(stream, 0, SEEK_END);
+    if (status != 0) {
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+cleanup:
+  if (status != 0) {
+    if (stream != NULL) {
+      /* Closing the stream releases the cookie. */
+      fclose(stream);
+      stream = NULL;
+      cookie = NULL;
+    }
+
+    buf_cookie_fini(cookie);
+    free(cookie);
+  }
+
+  return stream;
+}
+
+int
+ccstreams_buf_reset(FILE *stream, char **buf, size_t capacity, size_t *length)
+{
+  assert(stream != NULL);
+  assert(buf != NULL);
+  assert(*buf != NULL || capacity == 0);
+  assert(length != NULL);
+
+  int status = 0;
+  struct buf_cookie *buf_cookie = NULL;
+  struct ccstreams_stream *found = NULL;
+
+  found = ccstreams_stream_find(stream, CCSTREAMS_STREAM_BUF);
+  if (found == NULL) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  buf_cookie = (struct buf_cookie *)found;
+
+  if (*length > capacity) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  /* Only a character pushed back with ungetc(...) can be pending. */
+  status = fflush(stream);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (buf_cookie->mode.truncate) {
+    *length = 0;
+  }
+
+  buf_cookie->buf = buf;
+  buf_cookie->capacity = capacity;
+  buf_cookie->length = length;
+  buf_cookie->offset = 0;
+  buf_cookie->spilled = 0;
+
+  clearerr(stream);
+
+  /* Seeking through stdio resets its idea of the position. */
+  status = fseeko(stream, 0, buf_cookie->mode.end ? SEEK_END : SEEK_SET);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+cleanup:
+  return status;
+}
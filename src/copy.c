@@ -18,28 +18,553 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 
 #include <ccstreams/copy.h>
+#include <ccstreams/mem.h>
+#include <ccstreams/peek.h>
+
+#include "stream.h"
+#include "uring.h"
+
+/* Upper bound on a single kernel transfer (the kernel caps them a little
+ * below 2 GiB anyway).
+ */
+#define COPY_KERNEL_CHUNK (1 << 30)
 
+/* Minimum amount of space to reserve at a time when reading into a mem
+ * stream of unknown final size.
+ */
+#define COPY_RESERVE_CHUNK (64 * 1024)
+
+/* Bounds on the chunk size picked by ccstreams_copy(...). It starts at the
+ * larger of COPY_MIN_CHUNK and the preferred I/O size of the two ends and is
+ * doubled (up to COPY_MAX_CHUNK) for as long as that improves throughput.
+ */
+#define COPY_MIN_CHUNK (64 * 1024)
+#define COPY_MAX_CHUNK (4 * 1024 * 1024)
+
+/* Throughput is measured over rounds of this many chunks. A larger chunk is
+ * kept if it improves throughput by at least COPY_GAIN.
+ */
+#define COPY_ROUND 16
+#define COPY_GAIN 1.1
+
+/* Alignment of the buffers we allocate (suits page based and direct I/O). */
+#define COPY_ALIGN 4096
+
+struct copy_buffer {
+  char *data;
+  size_t size;
+  size_t limit;
+  int owned;
+};
+
+/* Make sure the buffer holds at least size bytes. A buffer supplied by the
+ * caller is never replaced (and size never exceeds its limit). Nothing in the
+ * buffer is kept.
+ */
+static
 int
-ccstreams_copy_by(FILE *from, FILE *to, size_t *bytes, size_t chunk)
+copy_buffer_reserve(struct copy_buffer *self, size_t size)
 {
-  assert(from != NULL);
-  assert(to != NULL);
-  assert(bytes != NULL);
-  assert(chunk != 0);
+  int status = 0;
+  void *data = NULL;
+
+  assert(size <= self->limit);
+
+  if (size <= self->size) {
+    goto cleanup;
+  }
+
+  status = posix_memalign(&data, COPY_ALIGN, size);
+  if (status != 0) {
+    errno = status;
+    status = -1;
+    goto cleanup;
+  }
+
+  free(self->data);
+  self->data = data;
+  self->size = size;
+
+cleanup:
+  return status;
+}
+
+static
+void
+copy_buffer_fini(struct copy_buffer *self)
+{
+  if (self->owned) {
+    free(self->data);
+  }
+
+  self->data = NULL;
+  self->size = 0;
+  self->limit = 0;
+  self->owned = 0;
+}
+
+/* The larger of chunk and the preferred I/O size for the descriptor (if any)
+ * behind stream: the block size of files and the capacity of pipes.
+ */
+static
+size_t
+copy_preferred(FILE *stream, size_t chunk)
+{
+  int fd = fileno(stream);
+  struct stat fd_stat;
+  size_t preferred = 0;
+
+  if (fd < 0 || fstat(fd, &fd_stat) != 0) {
+    return chunk;
+  }
+
+  preferred = fd_stat.st_blksize;
+
+#ifdef F_GETPIPE_SZ
+  if (S_ISFIFO(fd_stat.st_mode)) {
+    int pipe_size = fcntl(fd, F_GETPIPE_SZ);
+    if (pipe_size > 0) {
+      preferred = pipe_size;
+    }
+  }
+#endif
+
+  return preferred > chunk ? preferred : chunk;
+}
+
+static
+double
+copy_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+enum copy_method {
+  COPY_FILE_RANGE,
+  COPY_URING,
+  COPY_SENDFILE,
+  COPY_SPLICE,
+  COPY_METHODS,
+};
+
+static
+ssize_t
+copy_kernel(enum copy_method method, int in, int out, size_t count)
+{
+  switch (method) {
+#ifdef HAVE_COPY_FILE_RANGE
+    case COPY_FILE_RANGE:
+      return copy_file_range(in, NULL, out, NULL, count, 0);
+#endif
+    case COPY_URING:
+      return ccstreams_uring_copy(in, out, count);
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+    case COPY_SENDFILE:
+      return sendfile(out, in, NULL, count);
+#endif
+#ifdef HAVE_SPLICE
+    case COPY_SPLICE:
+      return splice(in, NULL, out, NULL, count, SPLICE_F_MOVE);
+#endif
+    default:
+      errno = ENOSYS;
+      return -1;
+  }
+}
+
+/* Whether the error from a first transfer means the method doesn't apply to
+ * the descriptors (rather than being an actual I/O error).
+ */
+static
+int
+copy_unsupported(int error)
+{
+  switch (error) {
+    case EBADF:
+    case EINVAL:
+    case ENOSYS:
+    case EOPNOTSUPP:
+    case EXDEV:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* The number of bytes stdio has buffered for reading from stream that have
+ * not been consumed, or -1 if that can't be determined.
+ */
+static
+ssize_t
+copy_buffered(FILE *stream)
+{
+#ifdef HAVE_STRUCT__IO_FILE__IO_BUF_BASE
+  /* Characters pushed back with ungetc(...) live in a separate area. */
+  if (stream->_IO_save_base != NULL) {
+    return -1;
+  }
+
+  return stream->_IO_read_end - stream->_IO_read_ptr;
+#else
+  return -1;
+#endif
+}
+
+/* Tell stdio where the descriptor behind stream is now, since it was moved
+ * behind its back. Streams that can't seek have no position to update.
+ */
+static
+int
+copy_resync(FILE *stream)
+{
+  off_t offset = lseek(fileno(stream), 0, SEEK_CUR);
+  if (offset == -1) {
+    return 0;
+  }
+
+  return fseeko(stream, offset, SEEK_SET);
+}
+
+/* Copy between the descriptors behind the streams entirely in the kernel.
+ * This only handles what it can: anything left over (including hitting the
+ * end of the input as far as stdio is concerned) is up to the caller.
+ */
+static
+int
+copy_fd(FILE *from, FILE *to, size_t *bytes, struct copy_buffer *buffer, size_t chunk)
+{
+  int status = 0;
+  int in = fileno(from);
+  int out = fileno(to);
+  struct stat in_stat;
+  struct stat out_stat;
+  int usable[COPY_METHODS] = {0};
+  enum copy_method method = COPY_FILE_RANGE;
+  ssize_t buffered = 0;
+  ssize_t transferred = 0;
+  int moved = 0;
+  int seekable = 0;
+
+  if (in < 0 || out < 0) {
+    goto cleanup;
+  }
+
+  if (fstat(in, &in_stat) != 0 || fstat(out, &out_stat) != 0) {
+    goto cleanup;
+  }
+
+  usable[COPY_FILE_RANGE] = S_ISREG(in_stat.st_mode) && S_ISREG(out_stat.st_mode);
+  /* Chunks are written out of order at explicit offsets, which appending
+   * would ignore.
+   */
+  usable[COPY_URING] = usable[COPY_FILE_RANGE] && !(fcntl(out, F_GETFL) & O_APPEND);
+  usable[COPY_SENDFILE] = S_ISREG(in_stat.st_mode);
+  usable[COPY_SPLICE] = S_ISFIFO(in_stat.st_mode) || S_ISFIFO(out_stat.st_mode);
+
+  if (!usable[COPY_FILE_RANGE] && !usable[COPY_SENDFILE] && !usable[COPY_SPLICE]) {
+    goto cleanup;
+  }
+
+  seekable = lseek(in, 0, SEEK_CUR) != -1;
+
+  /* Output stdio is holding on to has to come first. For input that can
+   * seek, flushing hands back what stdio read ahead by moving the descriptor
+   * back.
+   */
+  status = fflush(to);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (seekable) {
+    status = fflush(from);
+    if (status != 0) {
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+  buffered = copy_buffered(from);
+  if (buffered < 0 && !seekable) {
+    goto cleanup;
+  }
+
+  if (buffered > 0) {
+    status = copy_buffer_reserve(buffer, chunk);
+    if (status != 0) {
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+  /* Whatever stdio has read ahead (and can't give back) goes first. */
+  while (buffered > 0) {
+    size_t want = (size_t)buffered < chunk ? (size_t)buffered : chunk;
+    size_t bytes_read = fread(buffer->data, 1, want, from);
+    size_t bytes_written = fwrite(buffer->data, 1, bytes_read, to);
+    *bytes += bytes_written;
+
+    if (bytes_read < want || bytes_written < bytes_read) {
+      status = -1;
+      goto cleanup;
+    }
+
+    buffered -= bytes_read;
+  }
+
+  status = fflush(to);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  while (method < COPY_METHODS) {
+    if (!usable[method]) {
+      method++;
+      continue;
+    }
+
+    transferred = copy_kernel(method, in, out, COPY_KERNEL_CHUNK);
+    if (transferred > 0) {
+      *bytes += transferred;
+      moved = 1;
+      continue;
+    }
+
+    if (transferred == 0) {
+      break;
+    }
+
+    if (errno == EINTR) {
+      continue;
+    }
+
+    if (!moved && copy_unsupported(errno)) {
+      method++;
+      continue;
+    }
+
+    status = -1;
+    break;
+  }
+
+  if (moved) {
+    if (copy_resync(from) != 0 || copy_resync(to) != 0) {
+      status = -1;
+    }
+  }
+
+cleanup:
+  return status;
+}
 
+/* Write all of data to the descriptor (if any) behind stream, or failing
+ * that to the stream itself.
+ */
+static
+int
+copy_write(FILE *stream, const char *data, size_t size, size_t *bytes)
+{
+  int status = 0;
+  int out = fileno(stream);
+  ssize_t written = 0;
+
+  if (out < 0) {
+    written = fwrite(data, 1, size, stream);
+    *bytes += written;
+
+    if ((size_t)written < size) {
+      status = -1;
+    }
+
+    goto cleanup;
+  }
+
+  status = fflush(stream);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  while (size > 0) {
+    written = write(out, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      status = -1;
+      break;
+    }
+
+    *bytes += written;
+    data += written;
+    size -= written;
+  }
+
+  if (copy_resync(stream) != 0) {
+    status = -1;
+  }
+
+cleanup:
+  return status;
+}
+
+/* Copy out of a mem or str stream straight from its backing store. */
+static
+int
+copy_peek(FILE *from, FILE *to, size_t *bytes)
+{
+  int status = 0;
+  const char *data = NULL;
+  size_t avail = 0;
+  size_t written = 0;
+
+  if (ccstreams_stream_find(from, CCSTREAMS_STREAM_ANY) == NULL) {
+    goto cleanup;
+  }
+
+  /* Chunked streams give up their data a chunk at a time. */
+  do {
+    status = ccstreams_peek(from, &data, &avail);
+    if (status != 0) {
+      status = errno == EINVAL ? 0 : -1;
+      goto cleanup;
+    }
+
+    written = 0;
+    status = copy_write(to, data, avail, &written);
+    *bytes += written;
+
+    if (ccstreams_consume(from, written) != 0) {
+      status = -1;
+    }
+  } while (status == 0 && avail > 0);
+
+cleanup:
+  return status;
+}
+
+/* Copy into a mem stream by reading straight into the space reserved for
+ * the data. For a regular file the space for all of it is reserved up front.
+ * Reads this large bypass the stdio buffer of from.
+ */
+static
+int
+copy_reserve(FILE *from, FILE *to, size_t *bytes, size_t chunk)
+{
+  int status = 0;
+  int in = fileno(from);
+  struct stat in_stat;
+  off_t position = 0;
+  size_t want = chunk > COPY_RESERVE_CHUNK ? chunk : COPY_RESERVE_CHUNK;
+  size_t got = 0;
+  char *out = NULL;
+  int sized = 0;
+
+  /* Streams of our own have been copied out by copy_peek(...) already. */
+  if (ccstreams_stream_find(to, CCSTREAMS_STREAM_MEM) == NULL ||
+      ccstreams_stream_find(from, CCSTREAMS_STREAM_ANY) != NULL) {
+    goto cleanup;
+  }
+
+  if (in >= 0 && fstat(in, &in_stat) == 0 && S_ISREG(in_stat.st_mode)) {
+    position = ftello(from);
+    if (position < 0 || position >= in_stat.st_size) {
+      goto cleanup;
+    }
+
+    want = in_stat.st_size - position;
+    sized = 1;
+  }
+
+  do {
+    status = ccstreams_mem_reserve(to, want, &out);
+    if (status != 0) {
+      status = -1;
+      goto cleanup;
+    }
+
+    got = fread(out, 1, want, from);
+    *bytes += got;
+
+    status = ccstreams_mem_commit(to, got);
+    if (status != 0) {
+      status = -1;
+      goto cleanup;
+    }
+
+    if (got < want && ferror(from)) {
+      status = -1;
+      goto cleanup;
+    }
+  } while (!sized && got == want);
+
+cleanup:
+  return status;
+}
+
+/* Copy in chunks of the given size through buffer. If the buffer may grow
+ * beyond the chunk size, the chunk size is adapted to what gives the best
+ * throughput.
+ */
+static
+int
+copy_engine(FILE *from, FILE *to, size_t *bytes, struct copy_buffer *buffer, size_t chunk)
+{
   size_t bytes_read = 0;
   size_t bytes_written = 0;
 
   int status = 0;
-  char buffer[chunk];
+  int adapting = chunk < buffer->limit;
+  size_t round = 0;
+  double started = 0;
+  double best = 0;
+
+  status = copy_fd(from, to, bytes, buffer, chunk);
+  if (status != 0) {
+    return status;
+  }
+
+  status = copy_peek(from, to, bytes);
+  if (status != 0) {
+    return status;
+  }
+
+  status = copy_reserve(from, to, bytes, chunk);
+  if (status != 0) {
+    return status;
+  }
+
+  status = copy_buffer_reserve(buffer, chunk);
+  if (status != 0) {
+    return status;
+  }
+
+  if (adapting) {
+    started = copy_now();
+  }
 
   do {
-    bytes_read = fread(buffer, 1, chunk, from);
-    bytes_written = fwrite(buffer, 1, bytes_read, to);
+    bytes_read = fread(buffer->data, 1, chunk, from);
+    bytes_written = fwrite(buffer->data, 1, bytes_read, to);
     *bytes += bytes_written;
 
     if (bytes_read < chunk) {
@@ -55,13 +580,96 @@ ccstreams_copy_by(FILE *from, FILE *to, size_t *bytes, size_t chunk)
         break;
       }
     }
+
+    if (!adapting) {
+      continue;
+    }
+
+    round += bytes_written;
+    if (round < COPY_ROUND * chunk) {
+      continue;
+    }
+
+    double now = copy_now();
+    double rate = round / (now - started);
+
+    if (rate >= best * COPY_GAIN) {
+      best = rate;
+      chunk = chunk * 2 < buffer->limit ? chunk * 2 : buffer->limit;
+      adapting = chunk < buffer->limit;
+    }
+    else {
+      /* The previous (smaller) chunk did at least as well. */
+      chunk /= 2;
+      adapting = 0;
+    }
+
+    status = copy_buffer_reserve(buffer, chunk);
+    if (status != 0) {
+      break;
+    }
+
+    round = 0;
+    started = copy_now();
   } while (!feof(from));
 
   return status;
 }
 
+int
+ccstreams_copy_by(FILE *from, FILE *to, size_t *bytes, size_t chunk)
+{
+  assert(from != NULL);
+  assert(to != NULL);
+  assert(bytes != NULL);
+  assert(chunk != 0);
+
+  int status = 0;
+  struct copy_buffer buffer = {
+    .data = NULL,
+    .size = 0,
+    .limit = chunk,
+    .owned = 1,
+  };
+
+  status = copy_engine(from, to, bytes, &buffer, chunk);
+
+  copy_buffer_fini(&buffer);
+
+  return status;
+}
+
+int
+ccstreams_copy_with(FILE *from, FILE *to, size_t *bytes, char *buffer, size_t size)
+{
+  assert(from != NULL);
+  assert(to != NULL);
+  assert(bytes != NULL);
+  assert(buffer == NULL || size != 0);
+
+  int status = 0;
+  size_t chunk = 0;
+  struct copy_buffer copy_buffer = {
+    .data = buffer,
+    .size = buffer != NULL ? size : 0,
+    .limit = size != 0 ? size : COPY_MAX_CHUNK,
+    .owned = buffer == NULL,
+  };
+
+  chunk = copy_preferred(to, copy_preferred(from, COPY_MIN_CHUNK));
+  if (chunk > copy_buffer.limit) {
+    chunk = copy_buffer.limit;
+  }
+
+  status = copy_engine(from, to, bytes, &copy_buffer, chunk);
+
+  copy_buffer_fini(&copy_buffer);
+
+  return status;
+}
+
 int
 ccstreams_copy(FILE *from, FILE *to, size_t *bytes)
 {
-  return ccstreams_copy_by(from, to, bytes, 4096);
+  return ccstreams_copy_with(from, to, bytes, NULL, 0);
 }
@@ -0,0 +1,197 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccstreams/copy.h>
+
+/* Number of chunks that can be in flight between the reader and writer. */
+#define ASYNC_SLOTS 4
+
+/* Alignment of the ring buffers. */
+#define ASYNC_ALIGN 4096
+
+/* A ring of chunks filled by the reader (the calling thread) and drained by
+ * the writer thread. Everything past buffer is protected by lock.
+ */
+struct async_ring {
+  FILE *to;
+  char *buffer;
+  size_t chunk;
+
+  pthread_mutex_t lock;
+  pthread_cond_t filled;
+  pthread_cond_t drained;
+
+  size_t size[ASYNC_SLOTS];
+  size_t head;
+  size_t count;
+  size_t bytes;
+  int done;
+  int stopped;
+  int error;
+};
+
+static
+char *
+async_ring_slot(struct async_ring *self, size_t index)
+{
+  return self->buffer + (index % ASYNC_SLOTS) * self->chunk;
+}
+
+static
+void *
+async_writer(void *arg)
+{
+  struct async_ring *self = arg;
+
+  pthread_mutex_lock(&self->lock);
+
+  for (;;) {
+    while (self->count == 0 && !self->done && !self->stopped) {
+      pthread_cond_wait(&self->filled, &self->lock);
+    }
+
+    if (self->count == 0 || self->stopped) {
+      break;
+    }
+
+    size_t index = self->head;
+    size_t size = self->size[index % ASYNC_SLOTS];
+
+    pthread_mutex_unlock(&self->lock);
+    size_t bytes_written = fwrite(async_ring_slot(self, index), 1, size, self->to);
+    int error = errno;
+    pthread_mutex_lock(&self->lock);
+
+    self->bytes += bytes_written;
+    if (bytes_written < size) {
+      self->error = error != 0 ? error : EIO;
+      self->stopped = 1;
+    }
+
+    self->head++;
+    self->count--;
+    pthread_cond_signal(&self->drained);
+  }
+
+  pthread_mutex_unlock(&self->lock);
+
+  return NULL;
+}
+
+int
+ccstreams_copy_async(FILE *from, FILE *to, size_t *bytes, size_t chunk)
+{
+  assert(from != NULL);
+  assert(to != NULL);
+  assert(bytes != NULL);
+  assert(chunk != 0);
+
+  int status = 0;
+  int started = 0;
+  void *buffer = NULL;
+  pthread_t writer;
+  size_t tail = 0;
+  struct async_ring ring = {
+    .to = to,
+    .chunk = chunk,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .filled = PTHREAD_COND_INITIALIZER,
+    .drained = PTHREAD_COND_INITIALIZER,
+  };
+
+  status = posix_memalign(&buffer, ASYNC_ALIGN, ASYNC_SLOTS * chunk);
+  if (status != 0) {
+    errno = status;
+    status = -1;
+    goto cleanup;
+  }
+  ring.buffer = buffer;
+
+  status = pthread_create(&writer, NULL, async_writer, &ring);
+  if (status != 0) {
+    errno = status;
+    status = -1;
+    goto cleanup;
+  }
+  started = 1;
+
+  pthread_mutex_lock(&ring.lock);
+
+  for (;;) {
+    while (ring.count == ASYNC_SLOTS && !ring.stopped) {
+      pthread_cond_wait(&ring.drained, &ring.lock);
+    }
+
+    if (ring.stopped) {
+      break;
+    }
+
+    pthread_mutex_unlock(&ring.lock);
+    size_t bytes_read = fread(async_ring_slot(&ring, tail), 1, chunk, from);
+    int error = errno;
+    pthread_mutex_lock(&ring.lock);
+
+    if (bytes_read > 0) {
+      ring.size[tail % ASYNC_SLOTS] = bytes_read;
+      tail++;
+      ring.count++;
+    }
+
+    if (bytes_read < chunk) {
+      if (ferror(from) && ring.error == 0) {
+        ring.error = error != 0 ? error : EIO;
+      }
+
+      if (feof(from) || ferror(from)) {
+        ring.done = 1;
+        pthread_cond_signal(&ring.filled);
+        break;
+      }
+    }
+
+    pthread_cond_signal(&ring.filled);
+  }
+
+  pthread_mutex_unlock(&ring.lock);
+
+cleanup:
+  if (started) {
+    pthread_join(writer, NULL);
+
+    *bytes += ring.bytes;
+
+    if (ring.error != 0) {
+      errno = ring.error;
+      status = -1;
+    }
+  }
+
+  free(buffer);
+
+  pthread_mutex_destroy(&ring.lock);
+  pthread_cond_destroy(&ring.filled);
+  pthread_cond_destroy(&ring.drained);
+
+  return status;
+}
@@ -0,0 +1,261 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccstreams/copy.h>
+
+/* Number of chunks that can be in flight between the reader and the
+ * slowest writer.
+ */
+#define MULTI_SLOTS 4
+
+/* Alignment of the ring buffers. */
+#define MULTI_ALIGN 4096
+
+struct multi_ring;
+
+/* A writer thread and the destination it drains the ring into. */
+struct multi_writer {
+  struct multi_ring *ring;
+  FILE *to;
+  pthread_t thread;
+  size_t head;
+  size_t bytes;
+  int error;
+};
+
+/* A ring of chunks filled once by the reader (the calling thread) and
+ * drained by every writer at its own pace. Each filled chunk counts the
+ * writers that have yet to write it, and the reader only refills it once
+ * that is 0, so the slowest writer holds the reader back rather than memory
+ * growing. Everything past buffer is protected by lock.
+ */
+struct multi_ring {
+  char *buffer;
+  size_t chunk;
+
+  pthread_mutex_t lock;
+  pthread_cond_t filled;
+  pthread_cond_t drained;
+
+  size_t size[MULTI_SLOTS];
+  size_t refs[MULTI_SLOTS];
+  size_t tail;
+  size_t active;
+  int done;
+};
+
+static
+char *
+multi_ring_slot(struct multi_ring *self, size_t index)
+{
+  return self->buffer + (index % MULTI_SLOTS) * self->chunk;
+}
+
+/* Drop a writer's hold on the chunk at index. */
+static
+void
+multi_ring_release(struct multi_ring *self, size_t index)
+{
+  if (--self->refs[index % MULTI_SLOTS] == 0) {
+    pthread_cond_signal(&self->drained);
+  }
+}
+
+static
+void *
+multi_writer(void *arg)
+{
+  struct multi_writer *self = arg;
+  struct multi_ring *ring = self->ring;
+
+  pthread_mutex_lock(&ring->lock);
+
+  for (;;) {
+    while (self->head == ring->tail && !ring->done) {
+      pthread_cond_wait(&ring->filled, &ring->lock);
+    }
+
+    if (self->head == ring->tail) {
+      break;
+    }
+
+    size_t index = self->head;
+    size_t size = ring->size[index % MULTI_SLOTS];
+
+    pthread_mutex_unlock(&ring->lock);
+    size_t bytes_written = fwrite(multi_ring_slot(ring, index), 1, size, self->to);
+    int error = errno;
+    pthread_mutex_lock(&ring->lock);
+
+    self->bytes += bytes_written;
+
+    if (bytes_written < size) {
+      self->error = error != 0 ? error : EIO;
+
+      /* Give up this destination without holding up the others. */
+      for (; self->head != ring->tail; self->head++) {
+        multi_ring_release(ring, self->head);
+      }
+
+      ring->active--;
+      pthread_cond_signal(&ring->drained);
+      break;
+    }
+
+    multi_ring_release(ring, index);
+    self->head++;
+  }
+
+  pthread_mutex_unlock(&ring->lock);
+
+  return NULL;
+}
+
+int
+ccstreams_copy_multi(FILE *from, FILE **to, size_t n, size_t *bytes, size_t chunk)
+{
+  assert(from != NULL);
+  assert(to != NULL || n == 0);
+  assert(bytes != NULL || n == 0);
+  assert(chunk != 0);
+
+  int status = 0;
+  int error = 0;
+  void *buffer = NULL;
+  struct multi_writer *writers = NULL;
+  size_t started = 0;
+  size_t i = 0;
+  struct multi_ring ring = {
+    .chunk = chunk,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .filled = PTHREAD_COND_INITIALIZER,
+    .drained = PTHREAD_COND_INITIALIZER,
+  };
+
+  status = posix_memalign(&buffer, MULTI_ALIGN, MULTI_SLOTS * chunk);
+  if (status != 0) {
+    errno = status;
+    status = -1;
+    goto cleanup;
+  }
+  ring.buffer = buffer;
+
+  writers = calloc(n > 0 ? n : 1, sizeof(*writers));
+  if (writers == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  for (started = 0; started < n; started++) {
+    writers[started].ring = &ring;
+    writers[started].to = to[started];
+
+    pthread_mutex_lock(&ring.lock);
+    ring.active++;
+    pthread_mutex_unlock(&ring.lock);
+
+    status = pthread_create(&writers[started].thread, NULL, multi_writer, &writers[started]);
+    if (status != 0) {
+      pthread_mutex_lock(&ring.lock);
+      ring.active--;
+      pthread_mutex_unlock(&ring.lock);
+
+      errno = status;
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+  pthread_mutex_lock(&ring.lock);
+
+  while (ring.active > 0) {
+    size_t slot = ring.tail % MULTI_SLOTS;
+
+    while (ring.refs[slot] > 0 && ring.active > 0) {
+      pthread_cond_wait(&ring.drained, &ring.lock);
+    }
+
+    if (ring.active == 0) {
+      break;
+    }
+
+    pthread_mutex_unlock(&ring.lock);
+    size_t bytes_read = fread(multi_ring_slot(&ring, ring.tail), 1, chunk, from);
+    int read_error = errno;
+    pthread_mutex_lock(&ring.lock);
+
+    if (bytes_read > 0) {
+      ring.size[slot] = bytes_read;
+      ring.refs[slot] = ring.active;
+      ring.tail++;
+      pthread_cond_broadcast(&ring.filled);
+    }
+
+    if (bytes_read < chunk && (feof(from) || ferror(from))) {
+      if (ferror(from)) {
+        error = read_error != 0 ? read_error : EIO;
+      }
+
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&ring.lock);
+
+cleanup:
+  if (writers != NULL) {
+    int saved = errno;
+
+    pthread_mutex_lock(&ring.lock);
+    ring.done = 1;
+    pthread_cond_broadcast(&ring.filled);
+    pthread_mutex_unlock(&ring.lock);
+
+    for (i = 0; i < started; i++) {
+      pthread_join(writers[i].thread, NULL);
+
+      bytes[i] += writers[i].bytes;
+
+      if (error == 0) {
+        error = writers[i].error;
+      }
+    }
+
+    errno = saved;
+  }
+
+  if (error != 0) {
+    errno = error;
+    status = -1;
+  }
+
+  free(writers);
+  free(buffer);
+
+  pthread_mutex_destroy(&ring.lock);
+  pthread_cond_destroy(&ring.filled);
+  pthread_cond_destroy(&ring.drained);
+
+  return status;
+}
@@ -0,0 +1,46 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <ec/ec.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccstreams/buf.h>
+
+FILE *
+ecx_ccstreams_fbufopen(char **buf, size_t capacity, size_t *length, const char *mode,
+                       enum ccstreams_buf_overflow overflow)
+{
+  FILE *stream = ccstreams_fbufopen(buf, capacity, length, mode, overflow);
+  if (stream == NULL) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+
+  return stream;
+}
+
+void
+ecx_ccstreams_buf_reset(FILE *stream, char **buf, size_t capacity, size_t *length)
+{
+  int status = ccstreams_buf_reset(stream, buf, capacity, length);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+}
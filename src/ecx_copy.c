@@ -33,8 +33,38 @@ ecx_ccstreams_copy_by(FILE *from, FILE *to, size_t *bytes, size_t chunk)
   }
 }
 
+void
+ecx_ccstreams_copy_with(FILE *from, FILE *to, size_t *bytes, char *buffer, size_t size)
+{
+  int status = ccstreams_copy_with(from, to, bytes, buffer, size);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+}
+
 void
 ecx_ccstreams_copy(FILE *from, FILE *to, size_t *bytes)
 {
-  ecx_ccstreams_copy_by(from, to, bytes, 4096);
+  int status = ccstreams_copy(from, to, bytes);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+}
+
+void
+ecx_ccstreams_copy_async(FILE *from, FILE *to, size_t *bytes, size_t chunk)
+{
+  int status = ccstreams_copy_async(from, to, bytes, chunk);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+}
+
+void
+ecx_ccstreams_copy_multi(FILE *from, FILE **to, size_t n, size_t *bytes, size_t chunk)
+{
+  int status = ccstreams_copy_multi(from, to, n, bytes, chunk);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
 }
@@ -34,3 +34,60 @@ ecx_ccstreams_fmemopen(char **ptr, size_t *size, const char *mode)
 
   return stream;
 }
+
+FILE *
+ecx_ccstreams_fmemopen_options(char **ptr, size_t *size, const char *mode,
+                               const struct ccstreams_mem_options *options)
+{
+  FILE *stream = ccstreams_fmemopen_options(ptr, size, mode, options);
+  if (stream == NULL) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+
+  return stream;
+}
+
+void
+ecx_ccstreams_mem_reserve(FILE *stream, size_t n, char **out)
+{
+  int status = ccstreams_mem_reserve(stream, n, out);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+}
+
+void
+ecx_ccstreams_mem_commit(FILE *stream, size_t used)
+{
+  int status = ccstreams_mem_commit(stream, used);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+}
+
+void
+ecx_ccstreams_mem_reset(FILE *stream, char **ptr, size_t *size)
+{
+  int status = ccstreams_mem_reset(stream, ptr, size);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+}
+
+void
+ecx_ccstreams_mem_iov(FILE *stream, struct iovec *iov, size_t *count)
+{
+  int status = ccstreams_mem_iov(stream, iov, count);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+}
+
+void
+ecx_ccstreams_mem_flatten(FILE *stream)
+{
+  int status = ccstreams_mem_flatten(stream);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+}
@@ -0,0 +1,45 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <ec/ec.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccstreams/spool.h>
+
+FILE *
+ecx_ccstreams_fspoolopen(const char *mode, const struct ccstreams_spool_options *options)
+{
+  FILE *stream = ccstreams_fspoolopen(mode, options);
+  if (stream == NULL) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+
+  return stream;
+}
+
+void
+ecx_ccstreams_spool_fd(FILE *stream, int *fd)
+{
+  int status = ccstreams_spool_fd(stream, fd);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+}
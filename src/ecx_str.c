@@ -34,3 +34,24 @@ ecx_ccstreams_fstropen(char **str, const char *mode)
 
   return stream;
 }
+
+FILE *
+ecx_ccstreams_fstropen_options(char **str, const char *mode,
+                               const struct ccstreams_str_options *options)
+{
+  FILE *stream = ccstreams_fstropen_options(str, mode, options);
+  if (stream == NULL) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+
+  return stream;
+}
+
+void
+ecx_ccstreams_str_reset(FILE *stream, char **str)
+{
+  int status = ccstreams_str_reset(stream, str);
+  if (status != 0) {
+    ec_throw_errno(errno, NULL) NULL;
+  }
+}
@@ -0,0 +1,458 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <ccstreams/fdv.h>
+
+#include "stream.h"
+
+/* Size of the chunks output is copied into. Writes at least this large are
+ * sent from where they are.
+ */
+#define FDV_CHUNK (64 * 1024)
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+struct fdv_cookie {
+  struct ccstreams_stream stream;
+  int fd;
+  size_t bytes;
+  size_t segments;
+  char **chunks;
+  size_t count;
+  size_t slots;
+  size_t current;
+  size_t used;
+  struct iovec *iov;
+  size_t iovcnt;
+  size_t pending;
+};
+
+static
+int
+fdv_cookie_init(struct fdv_cookie *self, int fd, const struct ccstreams_fdv_options *options)
+{
+  int status = 0;
+
+  self->stream.file = NULL;
+  self->fd = fd;
+  self->bytes = options->bytes > 0 ? options->bytes : CCSTREAMS_FDV_BYTES;
+  self->segments = options->segments > 0 && options->segments < IOV_MAX ? options->segments : IOV_MAX;
+  self->chunks = NULL;
+  self->count = 0;
+  self->slots = 0;
+  self->current = 0;
+  self->used = 0;
+  self->iov = NULL;
+  self->iovcnt = 0;
+  self->pending = 0;
+
+  /* One more for a large write sent along with what is pending. */
+  self->iov = malloc((self->segments + 1) * sizeof(*self->iov));
+  if (self->iov == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+cleanup:
+  return status;
+}
+
+static
+void
+fdv_cookie_fini(struct fdv_cookie *self)
+{
+  size_t i = 0;
+
+  if (self == NULL) return;
+
+  for (i = 0; i < self->count; i++) {
+    free(self->chunks[i]);
+  }
+
+  free(self->chunks);
+  free(self->iov);
+
+  self->fd = -1;
+  self->chunks = NULL;
+  self->count = 0;
+  self->slots = 0;
+  self->current = 0;
+  self->used = 0;
+  self->iov = NULL;
+  self->iovcnt = 0;
+  self->pending = 0;
+}
+
+static
+struct fdv_cookie *
+fdv_cookie_find(FILE *stream)
+{
+  struct ccstreams_stream *found = ccstreams_stream_find(stream, CCSTREAMS_STREAM_FDV);
+  if (found == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  return (struct fdv_cookie *)found;
+}
+
+/* Send iovcnt segments of the pending iov, retrying short writes. On error
+ * the segments that weren't (fully) sent are left at the front of the iov.
+ */
+static
+int
+fdv_cookie_send(struct fdv_cookie *self, size_t iovcnt)
+{
+  int status = 0;
+  size_t first = 0;
+
+  while (first < iovcnt) {
+    ssize_t sent = writev(self->fd, self->iov + first, iovcnt - first);
+    if (sent == -1) {
+      if (errno == EINTR) continue;
+
+      status = -1;
+      break;
+    }
+
+    while (sent > 0) {
+      size_t n = (size_t)sent < self->iov[first].iov_len ? (size_t)sent : self->iov[first].iov_len;
+
+      self->iov[first].iov_base = (char *)self->iov[first].iov_base + n;
+      self->iov[first].iov_len -= n;
+      sent -= n;
+
+      if (self->iov[first].iov_len == 0) {
+        first++;
+      }
+    }
+
+    while (first < iovcnt && self->iov[first].iov_len == 0) {
+      first++;
+    }
+  }
+
+  if (status != 0) {
+    int saved = errno;
+    size_t i = 0;
+
+    memmove(self->iov, self->iov + first, (iovcnt - first) * sizeof(*self->iov));
+    self->iovcnt = iovcnt - first;
+
+    /* What was sent is no longer pending. */
+    self->pending = 0;
+    for (i = 0; i < self->iovcnt; i++) {
+      self->pending += self->iov[i].iov_len;
+    }
+
+    errno = saved;
+    goto cleanup;
+  }
+
+  /* Everything is out, so the chunks can be filled again. */
+  self->iovcnt = 0;
+  self->pending = 0;
+  self->current = 0;
+  self->used = 0;
+
+cleanup:
+  return status;
+}
+
+/* Copy data into the chunks as one more (or a longer last) segment.
+ * *copied is set to how much was taken, which on error may be less than
+ * size.
+ */
+static
+int
+fdv_cookie_copy(struct fdv_cookie *self, const char *buf, size_t size, size_t *copied)
+{
+  int status = 0;
+
+  *copied = 0;
+
+  while (size > 0) {
+    size_t n = 0;
+    char *at = NULL;
+
+    /* The iov is only full here if sending it failed. Nothing more can be
+     * taken until it goes.
+     */
+    if (self->iovcnt >= self->segments) {
+      status = fdv_cookie_send(self, self->iovcnt);
+      if (status != 0) {
+        status = -1;
+        goto cleanup;
+      }
+    }
+
+    if (self->count == 0 || self->used == FDV_CHUNK) {
+      if (self->count > 0) {
+        self->current++;
+        self->used = 0;
+      }
+
+      if (self->current == self->count) {
+        if (self->count == self->slots) {
+          size_t slots = self->slots > 0 ? self->slots * 2 : 4;
+          char **chunks = realloc(self->chunks, slots * sizeof(*chunks));
+          if (chunks == NULL) {
+            status = -1;
+            goto cleanup;
+          }
+
+          self->chunks = chunks;
+          self->slots = slots;
+        }
+
+        self->chunks[self->count] = malloc(FDV_CHUNK);
+        if (self->chunks[self->count] == NULL) {
+          status = -1;
+          goto cleanup;
+        }
+
+        self->count++;
+      }
+    }
+
+    n = FDV_CHUNK - self->used;
+    if (n > size) {
+      n = size;
+    }
+
+    at = self->chunks[self->current] + self->used;
+    memcpy(at, buf, n);
+
+    /* A segment never runs into the next chunk, even where the allocator
+     * happens to put it right after, so the segment threshold counts the
+     * same whatever the allocator does.
+     */
+    if (self->iovcnt > 0 && self->used > 0 &&
+        (char *)self->iov[self->iovcnt - 1].iov_base + self->iov[self->iovcnt - 1].iov_len == at) {
+      self->iov[self->iovcnt - 1].iov_len += n;
+    }
+    else {
+      self->iov[self->iovcnt].iov_base = at;
+      self->iov[self->iovcnt].iov_len = n;
+      self->iovcnt++;
+    }
+
+    self->used += n;
+    self->pending += n;
+    *copied += n;
+    buf += n;
+    size -= n;
+
+    if (self->iovcnt == self->segments) {
+      status = fdv_cookie_send(self, self->iovcnt);
+      if (status != 0) {
+        status = -1;
+        goto cleanup;
+      }
+    }
+  }
+
+cleanup:
+  return status;
+}
+
+static
+ssize_t
+fdv_write(void *cookie, const char *buf, size_t size)
+{
+  int status = 0;
+  struct fdv_cookie *fdv_cookie = cookie;
+  size_t copied = 0;
+
+  if (size >= FDV_CHUNK) {
+    /* Sent in place (it's only needed until writev(...) returns). The iov
+     * has a spare slot for it, even when full after a failed send.
+     */
+    size_t iovcnt = fdv_cookie->iovcnt;
+
+    assert(iovcnt <= fdv_cookie->segments);
+
+    fdv_cookie->iov[iovcnt].iov_base = (char *)buf;
+    fdv_cookie->iov[iovcnt].iov_len = size;
+    fdv_cookie->pending += size;
+
+    status = fdv_cookie_send(fdv_cookie, iovcnt + 1);
+    if (status != 0) {
+      /* The write is the last segment and wasn't all sent. What is left of
+       * it can't stay pending (the memory isn't ours), so report how much
+       * went: a short write (rather than -1) makes stdio flag the error.
+       */
+      struct iovec *last = &fdv_cookie->iov[--fdv_cookie->iovcnt];
+
+      fdv_cookie->pending -= last->iov_len;
+      return size - last->iov_len;
+    }
+
+    return size;
+  }
+
+  status = fdv_cookie_copy(fdv_cookie, buf, size, &copied);
+  if (status != 0) {
+    /* What was copied is held, and stdio mustn't hand it over again. */
+    return copied;
+  }
+
+  if (fdv_cookie->pending >= fdv_cookie->bytes) {
+    /* The data is held, a failure shows up on the next flush. */
+    fdv_cookie_send(fdv_cookie, fdv_cookie->iovcnt);
+  }
+
+  return size;
+}
+
+/* Registered only to be found again by ccstreams_fdv_flush(...). */
+static const struct ccstreams_stream_ops fdv_stream_ops = {
+  .peek = NULL,
+};
+
+static
+int
+fdv_close(void *cookie)
+{
+  int status = 0;
+  struct fdv_cookie *fdv_cookie = cookie;
+
+  ccstreams_stream_unregister(&fdv_cookie->stream);
+
+  status = fdv_cookie_send(fdv_cookie, fdv_cookie->iovcnt);
+
+  if (fdv_cookie->fd != -1 && close(fdv_cookie->fd) != 0) {
+    status = -1;
+  }
+
+  fdv_cookie_fini(fdv_cookie);
+  free(fdv_cookie);
+
+  return status;
+}
+
+FILE *
+ccstreams_fdvopen(int fd, const struct ccstreams_fdv_options *options)
+{
+  static const struct ccstreams_fdv_options defaults = {
+    .bytes = CCSTREAMS_FDV_BYTES,
+    .segments = 0,
+  };
+
+  int status = 0;
+  FILE *stream = NULL;
+  struct fdv_cookie *cookie = NULL;
+  cookie_io_functions_t fdv_io_funcs = {
+    .read  = NULL,
+    .write = fdv_write,
+    .seek  = NULL,
+    .close = fdv_close,
+  };
+
+  if (options == NULL) {
+    options = &defaults;
+  }
+
+  cookie = malloc(sizeof(*cookie));
+  if (cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = fdv_cookie_init(cookie, fd, options);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  stream = fopencookie(cookie, "w", fdv_io_funcs);
+  if (stream == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  ccstreams_stream_register(&cookie->stream, stream, CCSTREAMS_STREAM_FDV, &fdv_stream_ops);
+
+  /* The chunks are the buffer. */
+  status = setvbuf(stream, NULL, _IONBF, 0);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+cleanup:
+  if (status != 0) {
+    if (stream != NULL) {
+      /* Closing the stream releases the cookie, but fd isn't ours to close
+       * on failure.
+       */
+      cookie->fd = -1;
+      fclose(stream);
+      stream = NULL;
+      cookie = NULL;
+    }
+
+    if (cookie != NULL) {
+      fdv_cookie_fini(cookie);
+      free(cookie);
+    }
+  }
+
+  return stream;
+}
+
+int
+ccstreams_fdv_flush(FILE *stream)
+{
+  assert(stream != NULL);
+
+  int status = 0;
+  struct fdv_cookie *fdv_cookie = NULL;
+
+  fdv_cookie = fdv_cookie_find(stream);
+  if (fdv_cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  /* Output only sits in stdio if the caller buffered the stream. */
+  status = fflush(stream);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = fdv_cookie_send(fdv_cookie, fdv_cookie->iovcnt);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+cleanup:
+  return status;
+}
@@ -0,0 +1,257 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ccstreams/map.h>
+
+#include "mode.h"
+#include "stream.h"
+
+struct map_cookie {
+  struct ccstreams_stream stream;
+  char *ptr;
+  size_t size;
+  off_t offset;
+};
+
+static
+int
+map_cookie_init(struct map_cookie *self, const char *path, int flags)
+{
+  int status = 0;
+  int fd = -1;
+  struct stat st;
+
+  self->stream.file = NULL;
+  self->ptr = NULL;
+  self->size = 0;
+  self->offset = 0;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = fstat(fd, &st);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (!S_ISREG(st.st_mode)) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  /* An empty file can't be mapped (and has nothing to read anyway). */
+  if (st.st_size == 0) {
+    goto cleanup;
+  }
+
+  self->ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (self->ptr == MAP_FAILED) {
+    self->ptr = NULL;
+    status = -1;
+    goto cleanup;
+  }
+
+  self->size = st.st_size;
+
+  /* Only hints, so failures are ignored. */
+  madvise(self->ptr, self->size, (flags & CCSTREAMS_MAP_RANDOM) ? MADV_RANDOM : MADV_SEQUENTIAL);
+
+  if (flags & CCSTREAMS_MAP_WILLNEED) {
+    madvise(self->ptr, self->size, MADV_WILLNEED);
+  }
+
+cleanup:
+  /* The mapping holds its own reference to the file. */
+  if (fd != -1) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+  }
+
+  return status;
+}
+
+static
+void
+map_cookie_fini(struct map_cookie *self)
+{
+  if (self == NULL) return;
+
+  if (self->ptr != NULL) {
+    munmap(self->ptr, self->size);
+  }
+
+  self->ptr = NULL;
+  self->size = 0;
+  self->offset = 0;
+}
+
+static
+ssize_t
+map_read(void *cookie, char *buf, size_t size)
+{
+  struct map_cookie *map_cookie = cookie;
+
+  size_t bytes_read = map_cookie->size - map_cookie->offset;
+
+  if (bytes_read > size) {
+    bytes_read = size;
+  }
+
+  /* An empty file has no mapping to copy from. */
+  if (bytes_read == 0) {
+    return 0;
+  }
+
+  memcpy(buf, map_cookie->ptr + map_cookie->offset, bytes_read);
+  map_cookie->offset += bytes_read;
+
+  return bytes_read;
+}
+
+static
+int
+map_seek(void *cookie, off64_t *offset, int whence)
+{
+  int status = 0;
+  struct map_cookie *map_cookie = cookie;
+  off_t new_offset = map_cookie->offset;
+
+  switch (whence) {
+    case SEEK_SET:
+      new_offset = *offset;
+      break;
+    case SEEK_CUR:
+      new_offset += *offset;
+      break;
+    case SEEK_END:
+      new_offset = map_cookie->size + *offset;
+      break;
+  }
+
+  if (new_offset < 0 || map_cookie->size < (size_t)new_offset) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+cleanup:
+  if (status == 0) {
+    map_cookie->offset = new_offset;
+    *offset = new_offset;
+  }
+
+  return status;
+}
+
+static
+void
+map_peek(struct ccstreams_stream *stream, const char **data, size_t *avail)
+{
+  struct map_cookie *map_cookie = (struct map_cookie *)stream;
+
+  *data = map_cookie->ptr + map_cookie->offset;
+  *avail = map_cookie->size - map_cookie->offset;
+}
+
+static const struct ccstreams_stream_ops map_stream_ops = {
+  .peek = map_peek,
+};
+
+static
+int
+map_close(void *cookie)
+{
+  struct map_cookie *map_cookie = cookie;
+
+  ccstreams_stream_unregister(&map_cookie->stream);
+  map_cookie_fini(map_cookie);
+  free(map_cookie);
+
+  return 0;
+}
+
+FILE *
+ccstreams_fmapopen(const char *path, const char *mode, int flags)
+{
+  assert(path != NULL);
+  assert(mode != NULL);
+
+  int status = 0;
+  FILE *stream = NULL;
+  struct map_cookie *cookie = NULL;
+  cookie_io_functions_t map_io_funcs = {
+    .read  = map_read,
+    .write = NULL,
+    .seek  = map_seek,
+    .close = map_close,
+  };
+  struct ccstreams_mode parsed;
+
+  ccstreams_mode_parse(&parsed, mode);
+
+  if (parsed.writable) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  cookie = malloc(sizeof(*cookie));
+  if (cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = map_cookie_init(cookie, path, flags);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  stream = fopencookie(cookie, mode, map_io_funcs);
+  if (stream == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  ccstreams_stream_register(&cookie->stream, stream, CCSTREAMS_STREAM_MAP, &map_stream_ops);
+
+cleanup:
+  if (status != 0) {
+    if (cookie != NULL) {
+      map_cookie_fini(cookie);
+      free(cookie);
+    }
+  }
+
+  return stream;
+}
@@ -18,32 +18,66 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <ccstreams/mem.h>
 
+#include "alloc.h"
+#include "mode.h"
+#include "rope.h"
+#include "stream.h"
+
+/* Size of the stdio buffer kept after the end of the data in direct mode. */
+#define MEM_WINDOW BUFSIZ
+
 struct mem_cookie {
+  struct ccstreams_stream stream;
+  struct ccstreams_allocator allocator;
   char **ptr;
+  char *buffer;
   size_t *size;
+  size_t capacity;
+  size_t *allocated;
+  double growth;
+  size_t hint;
   off_t offset;
-  int append;
+  struct ccstreams_mode mode;
+  int direct;
+  char *window;
+  size_t reserved;
 };
 
 static
 int
-mem_cookie_init(struct mem_cookie *self, char **ptr, size_t *size, const int append)
+mem_cookie_init(struct mem_cookie *self, const struct ccstreams_allocator *allocator, const struct ccstreams_mode *mode, char **ptr, size_t *size, size_t *allocated, const size_t capacity, const double growth, const size_t hint)
 {
   assert(ptr != NULL);
   assert(*ptr != NULL);
   assert(size != NULL);
+  assert(*size <= capacity);
 
   int status = 0;
 
+  self->allocator = *allocator;
   self->ptr = ptr;
+  self->buffer = *ptr;
   self->size = size;
+  self->capacity = capacity;
+  self->allocated = allocated;
+  self->growth = growth > 1 ? growth : CCSTREAMS_MEM_GROWTH;
+  self->hint = hint;
   self->offset = 0;
-  self->append = append;
+  self->mode = *mode;
+  self->direct = 0;
+  self->stream.file = NULL;
+  self->window = NULL;
+  self->reserved = 0;
+
+  if (allocated != NULL) {
+    *allocated = capacity;
+  }
 
   return 0;
 }
@@ -55,9 +89,186 @@ mem_cookie_fini(struct mem_cookie *self)
   if (self == NULL) return;
 
   self->ptr = NULL;
+  self->buffer = NULL;
   self->size = NULL;
+  self->capacity = 0;
+  self->allocated = NULL;
+  self->growth = 0;
+  self->hint = 0;
   self->offset = 0;
-  self->append = 0;
+  memset(&self->mode, 0, sizeof(self->mode));
+  self->direct = 0;
+  self->window = NULL;
+  self->reserved = 0;
+}
+
+/* Let the caller know the size of the allocation behind *ptr (if asked). */
+static
+void
+mem_cookie_publish(struct mem_cookie *self)
+{
+  if (self->allocated != NULL) {
+    *self->allocated = self->capacity;
+  }
+}
+
+/* Ensure the buffer can hold at least needed bytes. The capacity is grown
+ * geometrically so that a sequence of writes costs amortized constant time
+ * per byte.
+ */
+static
+int
+mem_cookie_reserve(struct mem_cookie *self, size_t needed)
+{
+  int status = 0;
+  char *ptr = NULL;
+  double scaled = 0;
+  size_t capacity = 0;
+
+  if (needed <= self->capacity) {
+    goto cleanup;
+  }
+
+  scaled = self->capacity * self->growth;
+  capacity = scaled < (double)SIZE_MAX ? (size_t)scaled : SIZE_MAX;
+  if (capacity < needed) {
+    capacity = needed;
+  }
+
+  ptr = self->allocator.grow(self->allocator.context, self->buffer, self->capacity, capacity);
+  if (ptr == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  self->buffer = ptr;
+  *self->ptr = ptr;
+  self->capacity = capacity;
+  mem_cookie_publish(self);
+
+cleanup:
+  return status;
+}
+
+#ifdef HAVE_STRUCT__IO_FILE__IO_BUF_BASE
+/* Check that the stdio buffer is still the window we put there (it won't be
+ * if the caller replaced it with setvbuf(...)).
+ */
+static
+int
+mem_cookie_direct(struct mem_cookie *self)
+{
+  if (self->direct && self->stream.file->_IO_buf_base != self->window) {
+    self->direct = 0;
+  }
+
+  return self->direct;
+}
+
+/* Move the stdio buffer to the space after the end of the data. This is
+ * called from within the write function, after which stdio resets its read
+ * and write pointers to the start of the buffer.
+ */
+static
+void
+mem_cookie_window(struct mem_cookie *self)
+{
+  self->window = self->buffer + *self->size;
+  self->stream.file->_IO_buf_base = self->window;
+  self->stream.file->_IO_buf_end = self->window + MEM_WINDOW;
+}
+#else
+static
+int
+mem_cookie_direct(struct mem_cookie *self)
+{
+  return self->direct = 0;
+}
+
+static
+void
+mem_cookie_window(struct mem_cookie *self)
+{
+}
+#endif
+
+/* Move the stdio buffer to the space after the end of the data from outside
+ * of the write function (the stream must have been flushed).
+ */
+static
+int
+mem_cookie_rewindow(struct mem_cookie *self)
+{
+  self->window = self->buffer + *self->size;
+
+  return setvbuf(self->stream.file, self->window, _IOFBF, MEM_WINDOW);
+}
+
+static
+struct mem_cookie *
+mem_cookie_find(FILE *stream)
+{
+  struct ccstreams_stream *found = ccstreams_stream_find(stream, CCSTREAMS_STREAM_MEM);
+  if (found == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  return (struct mem_cookie *)found;
+}
+
+/* Check whether the caller has taken the buffer (after a flush) and put
+ * something else in *ptr. It can't be moved or freed after that.
+ */
+static
+int
+mem_cookie_taken(struct mem_cookie *self)
+{
+  return *self->ptr != self->buffer;
+}
+
+/* Shrink the buffer to exactly *size bytes. Failing to shrink leaves the
+ * (larger) buffer in place, which is still valid, and returns -1. A buffer
+ * that was taken is left as it was.
+ */
+static
+int
+mem_cookie_fit(struct mem_cookie *self)
+{
+  int status = 0;
+  char *ptr = NULL;
+
+  if (self->capacity == *self->size || mem_cookie_taken(self)) {
+    goto cleanup;
+  }
+
+  if (*self->size == 0) {
+    /* Growing to 0 isn't allowed (realloc(ptr, 0) frees ptr), so match the
+     * empty allocation used on open.
+     */
+    ptr = self->allocator.alloc(self->allocator.context, 0);
+    if (ptr == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+
+    self->allocator.free(self->allocator.context, self->buffer, self->capacity);
+  }
+  else {
+    ptr = self->allocator.grow(self->allocator.context, self->buffer, self->capacity, *self->size);
+    if (ptr == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+  self->buffer = ptr;
+  *self->ptr = ptr;
+  self->capacity = *self->size;
+  mem_cookie_publish(self);
+
+cleanup:
+  return status;
 }
 
 static
@@ -66,7 +277,7 @@ mem_read(void *cookie, char *buf, size_t size)
 {
   struct mem_cookie *mem_cookie = cookie;
 
-  char *ptr = *mem_cookie->ptr + mem_cookie->offset;
+  char *ptr = mem_cookie->buffer + mem_cookie->offset;
   size_t bytes_read = 0;
 
   if (mem_cookie->offset + size > *mem_cookie->size) {
@@ -90,30 +301,46 @@ mem_write(void *cookie, const char *buf, size_t size)
   struct mem_cookie *mem_cookie = cookie;
 
   size_t bytes_written = size;
-  int append = mem_cookie->append;
+  int append = mem_cookie->mode.append;
+  int direct = mem_cookie_direct(mem_cookie);
+
+  uintptr_t base = (uintptr_t)mem_cookie->buffer;
+  uintptr_t from = (uintptr_t)buf;
+  int inside = from >= base && from < base + mem_cookie->capacity;
 
-  char *ptr = *mem_cookie->ptr;
   size_t new_size = *mem_cookie->size;
-  size_t offset = (append ? new_size : mem_cookie->offset) + size;
+  size_t start = append ? new_size : mem_cookie->offset;
+  size_t offset = start + size;
 
   if (new_size < offset) {
     new_size = offset;
   }
 
-  ptr = realloc(ptr, new_size);
-  if (ptr == NULL) {
+  status = mem_cookie_reserve(mem_cookie, new_size + (direct ? MEM_WINDOW : 0));
+  if (status != 0) {
     status = -1;
     goto cleanup;
   }
 
-  *mem_cookie->ptr = ptr;
+  /* In direct mode the data is usually in the window already, which may
+   * have moved with the buffer. Output that was buffered while reading (or
+   * written somewhere other than the end) still has to be moved into place.
+   */
+  if (direct && inside) {
+    buf = mem_cookie->buffer + (from - base);
+  }
 
-  ptr += append ? *mem_cookie->size : mem_cookie->offset;
-  memcpy(ptr, buf, bytes_written);
+  if (buf != mem_cookie->buffer + start) {
+    memmove(mem_cookie->buffer + start, buf, bytes_written);
+  }
 
   *mem_cookie->size = new_size;
   mem_cookie->offset = append ? mem_cookie->offset : offset;
 
+  if (direct) {
+    mem_cookie_window(mem_cookie);
+  }
+
 cleanup:
   if (status != 0) {
     return status;
@@ -156,25 +383,204 @@ cleanup:
   return status;
 }
 
+static
+void
+mem_peek(struct ccstreams_stream *stream, const char **data, size_t *avail)
+{
+  struct mem_cookie *mem_cookie = (struct mem_cookie *)stream;
+
+  *data = mem_cookie->buffer + mem_cookie->offset;
+  *avail = *mem_cookie->size - mem_cookie->offset;
+}
+
+static
+void
+mem_iov(struct ccstreams_stream *stream, struct iovec *iov, size_t *count)
+{
+  struct mem_cookie *mem_cookie = (struct mem_cookie *)stream;
+
+  if (*count > 0) {
+    iov[0].iov_base = mem_cookie->buffer;
+    iov[0].iov_len = *mem_cookie->size;
+  }
+
+  *count = 1;
+}
+
+static
+int
+mem_writev(struct ccstreams_stream *stream, const struct iovec *iov, int iovcnt, size_t total, off_t *offset)
+{
+  int status = 0;
+  struct mem_cookie *mem_cookie = (struct mem_cookie *)stream;
+
+  size_t window = mem_cookie_direct(mem_cookie) ? MEM_WINDOW : 0;
+  size_t start = mem_cookie->mode.append ? *mem_cookie->size : mem_cookie->offset;
+  size_t needed = *mem_cookie->size;
+  int i = 0;
+
+  if (!mem_cookie->mode.writable) {
+    status = -1;
+    errno = EBADF;
+    goto cleanup;
+  }
+
+  if (total > SIZE_MAX - window - start) {
+    status = -1;
+    errno = EOVERFLOW;
+    goto cleanup;
+  }
+
+  if (needed < start + total) {
+    needed = start + total;
+  }
+
+  status = mem_cookie_reserve(mem_cookie, needed + window);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  /* With the room there each write is a plain copy. */
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len == 0) continue;
+
+    if (mem_write(mem_cookie, iov[i].iov_base, iov[i].iov_len) < 0) {
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+  *offset = mem_cookie->offset;
+
+cleanup:
+  return status;
+}
+
+static const struct ccstreams_stream_ops mem_stream_ops = {
+  .peek = mem_peek,
+  .iov = mem_iov,
+  .writev = mem_writev,
+};
+
 static
 int
 mem_close(void *cookie)
 {
   int status = 0;
   struct mem_cookie *mem_cookie = cookie;
+  struct ccstreams_allocator allocator = mem_cookie->allocator;
 
+  ccstreams_stream_unregister(&mem_cookie->stream);
+
+  /* Failing to shrink still leaves valid data in *ptr (the allocated option
+   * tells the caller how big it is), so it isn't an error.
+   */
+  mem_cookie_fit(mem_cookie);
   mem_cookie_fini(mem_cookie);
-  free(mem_cookie);
+  allocator.free(allocator.context, mem_cookie, sizeof(*mem_cookie));
+
+  return status;
+}
+
+/* Get the buffer at *ptr ready for a stream opened with mode: allocate it if
+ * it is missing (and the mode allows it), empty it if the mode truncates and
+ * reserve the initial capacity (hint bytes for a writable stream, plus the
+ * window in direct mode). *created is set if the buffer was allocated here.
+ * On failure nothing allocated here is kept.
+ */
+static
+int
+mem_buffer_prepare(const struct ccstreams_allocator *allocator, const struct ccstreams_mode *mode,
+                   char **ptr, size_t *size, size_t hint, int direct,
+                   size_t *capacity, int *created)
+{
+  int status = 0;
+
+  *created = 0;
+
+  if (mode->create && *ptr == NULL) {
+    *ptr = allocator->alloc(allocator->context, 0);
+    if (*ptr == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+
+    *created = 1;
+    *size = 0;
+  }
+
+  if (*ptr == NULL) {
+    status = -1;
+    errno = ENOENT;
+    goto cleanup;
+  }
+
+  if (mode->truncate && !*created) {
+    char *empty = allocator->alloc(allocator->context, 0);
+    if (empty == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+
+    allocator->free(allocator->context, *ptr, *size);
+    *ptr = empty;
+    *size = 0;
+  }
+
+  *capacity = *size;
+  if (mode->writable && *capacity < hint) {
+    *capacity = hint;
+  }
+
+  if (direct && *capacity < *size + MEM_WINDOW) {
+    *capacity = *size + MEM_WINDOW;
+  }
+
+  if (*capacity != *size) {
+    char *reserved = allocator->grow(allocator->context, *ptr, *size, *capacity);
+    if (reserved == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+
+    *ptr = reserved;
+  }
+
+cleanup:
+  if (status != 0 && *created) {
+    allocator->free(allocator->context, *ptr, 0);
+    *ptr = NULL;
+    *created = 0;
+  }
 
   return status;
 }
 
 FILE *
 ccstreams_fmemopen(char **ptr, size_t *size, const char *mode)
+{
+  return ccstreams_fmemopen_options(ptr, size, mode, NULL);
+}
+
+FILE *
+ccstreams_fmemopen_options(char **ptr, size_t *size, const char *mode,
+                           const struct ccstreams_mem_options *options)
 {
   assert(ptr != NULL);
   assert(size != NULL);
 
+  static const struct ccstreams_mem_options defaults = {
+    .capacity = 0,
+    .growth = CCSTREAMS_MEM_GROWTH,
+    .flags = 0,
+    .allocator = NULL,
+    .chunk = 0,
+    .allocated = NULL,
+    .chunks = NULL,
+    .chunk_count = NULL,
+  };
+
   int status = 0;
   FILE *stream = NULL;
   struct mem_cookie *cookie = NULL;
@@ -184,105 +590,396 @@ ccstreams_fmemopen(char **ptr, size_t *size, const char *mode)
     .seek  = mem_seek,
     .close = mem_close,
   };
-  size_t mode_length = strlen(mode);
-  int extra = 0;
-  int create = 0;
+  struct ccstreams_mode parsed;
   int created = 0;
-  int append = 0;
-  int truncate = 0;
-  int end = 0;
-
-  if (mode_length > 1) {
-    if (mode[1] == 'b') {
-      if (mode_length > 2 && mode[2] == '+') {
-        extra = 2;
-      }
+  int direct = 0;
+  size_t capacity = 0;
+  size_t allocated = 0;
+  const struct ccstreams_allocator *allocator = NULL;
+
+  if (options == NULL) {
+    options = &defaults;
+  }
+
+  if (options->flags & CCSTREAMS_MEM_CHUNKED) {
+    return ccstreams_rope_open(ptr, size, mode, options);
+  }
+
+  allocator = options->allocator;
+  if (allocator == NULL) {
+    allocator = &ccstreams_allocator_default;
+  }
+
+  ccstreams_mode_parse(&parsed, mode);
+
+#ifdef HAVE_STRUCT__IO_FILE__IO_BUF_BASE
+  direct = (options->flags & CCSTREAMS_MEM_DIRECT) && parsed.writable;
+#endif
+
+  status = mem_buffer_prepare(allocator, &parsed, ptr, size, options->capacity, direct, &capacity, &created);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+  allocated = capacity;
+
+  cookie = allocator->alloc(allocator->context, sizeof(*cookie));
+  if (cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = mem_cookie_init(cookie, allocator, &parsed, ptr, size, options->allocated, capacity, options->growth, options->capacity);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  stream = fopencookie(cookie, mode, mem_io_funcs);
+  if (stream == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  ccstreams_stream_register(&cookie->stream, stream, CCSTREAMS_STREAM_MEM, &mem_stream_ops);
+
+  if (direct) {
+    cookie->window = *ptr + *size;
+
+    status = setvbuf(stream, cookie->window, _IOFBF, MEM_WINDOW);
+    if (status != 0) {
+      status = -1;
+      goto cleanup;
     }
-    else if (mode[1] == '+') {
-      extra = 1;
+
+    cookie->direct = 1;
+  }
+
+  if (parsed.end) {
+    status = fseek(stream, 0, SEEK_END);
+    if (status != 0) {
+      status = -1;
+      goto cleanup;
     }
   }
 
-  switch (mode[0]) {
-    case 'w':
-      if (extra) {
-        create = 1;
-      }
-      truncate = 1;
-      break;
-    case 'a':
-      if (!extra) {
-        end = 1;
-      }
-      create = 1;
-      append = 1;
-      break;
+cleanup:
+  if (status != 0) {
+    if (stream != NULL) {
+      /* Closing the stream releases the cookie (and fits the buffer). */
+      fclose(stream);
+      stream = NULL;
+      cookie = NULL;
+      allocated = *size;
+    }
+
+    if (cookie != NULL) {
+      mem_cookie_fini(cookie);
+      allocator->free(allocator->context, cookie, sizeof(*cookie));
+    }
+
+    if (created) {
+      allocator->free(allocator->context, *ptr, allocated);
+      *ptr = NULL;
+    }
   }
 
-  if (create && *ptr == NULL) {
-    *ptr = malloc(0);
-    if (*ptr == NULL) {
+  return stream;
+}
+
+int
+ccstreams_mem_reserve(FILE *stream, size_t n, char **out)
+{
+  assert(stream != NULL);
+  assert(out != NULL);
+
+  int status = 0;
+  struct mem_cookie *mem_cookie = NULL;
+  size_t start = 0;
+  size_t needed = 0;
+  size_t window = 0;
+  int direct = 0;
+
+  mem_cookie = mem_cookie_find(stream);
+  if (mem_cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (!mem_cookie->mode.writable) {
+    status = -1;
+    errno = EBADF;
+    goto cleanup;
+  }
+
+  /* Pending output has to land first and the offset has to reflect the
+   * position of the stream (rather than how far stdio has read ahead).
+   */
+  status = fflush(stream);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  direct = mem_cookie_direct(mem_cookie);
+  window = direct ? MEM_WINDOW : 0;
+  start = mem_cookie->mode.append ? *mem_cookie->size : mem_cookie->offset;
+
+  if (n > SIZE_MAX - window - start) {
+    status = -1;
+    errno = EOVERFLOW;
+    goto cleanup;
+  }
+
+  needed = start + n;
+  if (needed < *mem_cookie->size) {
+    needed = *mem_cookie->size;
+  }
+
+  status = mem_cookie_reserve(mem_cookie, needed + window);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (direct) {
+    status = mem_cookie_rewindow(mem_cookie);
+    if (status != 0) {
       status = -1;
       goto cleanup;
     }
+  }
 
-    created = 1;
-    *size = 0;
+  mem_cookie->reserved = n;
+  *out = mem_cookie->buffer + start;
+
+cleanup:
+  return status;
+}
+
+int
+ccstreams_mem_commit(FILE *stream, size_t used)
+{
+  assert(stream != NULL);
+
+  int status = 0;
+  struct mem_cookie *mem_cookie = NULL;
+  size_t start = 0;
+  size_t end = 0;
+
+  mem_cookie = mem_cookie_find(stream);
+  if (mem_cookie == NULL) {
+    status = -1;
+    goto cleanup;
   }
 
-  if (*ptr == NULL) {
+  if (used > mem_cookie->reserved) {
     status = -1;
-    errno = ENOENT;
+    errno = EINVAL;
     goto cleanup;
   }
 
-  if (truncate & !created) {
-    free(*ptr);
-    *ptr = malloc(0);
-    if (*ptr == NULL) {
+  start = mem_cookie->mode.append ? *mem_cookie->size : mem_cookie->offset;
+  end = start + used;
+
+  if (*mem_cookie->size < end) {
+    *mem_cookie->size = end;
+  }
+
+  mem_cookie->reserved = 0;
+
+  if (mem_cookie_direct(mem_cookie)) {
+    status = mem_cookie_rewindow(mem_cookie);
+    if (status != 0) {
       status = -1;
       goto cleanup;
     }
+  }
 
-    *size = 0;
+  /* Seeking through stdio keeps its idea of the position in sync. */
+  status = fseeko(stream, mem_cookie->mode.append ? mem_cookie->offset : (off_t)end, SEEK_SET);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
   }
 
-  cookie = malloc(sizeof(*cookie));
-  if (cookie == NULL) {
+cleanup:
+  return status;
+}
+
+int
+ccstreams_mem_reset(FILE *stream, char **ptr, size_t *size)
+{
+  assert(stream != NULL);
+  assert(ptr != NULL);
+  assert(size != NULL);
+
+  int status = 0;
+  struct mem_cookie *mem_cookie = NULL;
+  size_t capacity = 0;
+  size_t length = 0;
+  int created = 0;
+  int direct = 0;
+  int taken = 0;
+
+  mem_cookie = mem_cookie_find(stream);
+  if (mem_cookie == NULL) {
     status = -1;
     goto cleanup;
   }
 
-  status = mem_cookie_init(cookie, ptr, size, append);
+  /* Output pending for the old buffer lands there. */
+  status = fflush(stream);
   if (status != 0) {
     status = -1;
     goto cleanup;
   }
 
-  stream = fopencookie(cookie, mode, mem_io_funcs);
-  if (stream == NULL) {
+  direct = mem_cookie_direct(mem_cookie);
+  taken = mem_cookie_taken(mem_cookie);
+  length = *mem_cookie->size;
+
+  /* Leave the old buffer as closing the stream would (unless it was taken,
+   * in which case it stays as it was after the flush). It has to be exactly
+   * *size bytes: the allocated option only follows the current buffer.
+   */
+  status = mem_cookie_fit(mem_cookie);
+  if (status != 0) {
     status = -1;
     goto cleanup;
   }
 
-  if (end) {
-    status = fseek(stream, 0, SEEK_END);
+  status = mem_buffer_prepare(&mem_cookie->allocator, &mem_cookie->mode,
+                              ptr, size, mem_cookie->hint, direct,
+                              &capacity, &created);
+  if (status != 0) {
+    status = -1;
+
+    /* The stream stays on the old buffer. One that was taken is handed back,
+     * and one given again may have just been changed under it.
+     */
+    if (taken) {
+      *mem_cookie->ptr = mem_cookie->buffer;
+      *mem_cookie->size = length;
+    }
+    else if (ptr == mem_cookie->ptr) {
+      mem_cookie->buffer = *ptr;
+      mem_cookie->capacity = *size;
+    }
+
+    /* The window went with the space after the old buffer. */
+    if (direct) {
+      mem_cookie->direct = 0;
+      setvbuf(stream, NULL, _IONBF, 0);
+    }
+
+    goto cleanup;
+  }
+
+  mem_cookie->ptr = ptr;
+  mem_cookie->buffer = *ptr;
+  mem_cookie->size = size;
+  mem_cookie->capacity = capacity;
+  mem_cookie->offset = 0;
+  mem_cookie->reserved = 0;
+
+  if (direct) {
+    status = mem_cookie_rewindow(mem_cookie);
     if (status != 0) {
       status = -1;
       goto cleanup;
     }
   }
 
+  clearerr(stream);
+
+  /* Seeking through stdio resets its idea of the position. */
+  status = fseeko(stream, 0, mem_cookie->mode.end ? SEEK_END : SEEK_SET);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
 cleanup:
+  if (mem_cookie != NULL) {
+    mem_cookie_publish(mem_cookie);
+  }
+
+  return status;
+}
+
+/* The mem streams that can describe their data as segments (plain and
+ * chunked).
+ */
+static
+struct ccstreams_stream *
+mem_stream_find(FILE *stream)
+{
+  struct ccstreams_stream *found = ccstreams_stream_find(stream, CCSTREAMS_STREAM_ANY);
+  if (found == NULL || found->ops->iov == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  return found;
+}
+
+int
+ccstreams_mem_iov(FILE *stream, struct iovec *iov, size_t *count)
+{
+  assert(stream != NULL);
+  assert(count != NULL);
+  assert(iov != NULL || *count == 0);
+
+  int status = 0;
+  struct ccstreams_stream *found = NULL;
+
+  found = mem_stream_find(stream);
+  if (found == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = fflush(stream);
   if (status != 0) {
-    mem_cookie_fini(cookie);
-    free(cookie);
+    status = -1;
+    goto cleanup;
+  }
 
-    if (created) {
-      free(*ptr);
-      *ptr = NULL;
+  found->ops->iov(found, iov, count);
+
+cleanup:
+  return status;
+}
+
+int
+ccstreams_mem_flatten(FILE *stream)
+{
+  assert(stream != NULL);
+
+  int status = 0;
+  struct ccstreams_stream *found = NULL;
+
+  found = mem_stream_find(stream);
+  if (found == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = fflush(stream);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (found->ops->flatten != NULL) {
+    status = found->ops->flatten(found);
+    if (status != 0) {
+      status = -1;
+      goto cleanup;
     }
   }
 
-  return stream;
+cleanup:
+  return status;
 }
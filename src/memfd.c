@@ -0,0 +1,396 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ccstreams/memfd.h>
+
+#include "mode.h"
+#include "stream.h"
+
+/* The factor by which the file grows when a write doesn't fit. */
+#define MEMFD_GROWTH 2
+
+struct memfd_cookie {
+  struct ccstreams_stream stream;
+  int fd;
+  char *ptr;
+  size_t size;
+  size_t capacity;
+  off_t offset;
+  struct ccstreams_mode mode;
+};
+
+static
+int
+memfd_cookie_init(struct memfd_cookie *self, int fd, const struct ccstreams_mode *mode)
+{
+  int status = 0;
+  struct stat st;
+
+  self->stream.file = NULL;
+  self->fd = fd;
+  self->ptr = NULL;
+  self->size = 0;
+  self->capacity = 0;
+  self->offset = 0;
+  self->mode = *mode;
+
+  if (mode->writable) {
+    goto cleanup;
+  }
+
+  status = fstat(fd, &st);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (st.st_size == 0) {
+    goto cleanup;
+  }
+
+  self->ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (self->ptr == MAP_FAILED) {
+    self->ptr = NULL;
+    status = -1;
+    goto cleanup;
+  }
+
+  self->size = st.st_size;
+  self->capacity = st.st_size;
+
+cleanup:
+  return status;
+}
+
+static
+void
+memfd_cookie_fini(struct memfd_cookie *self)
+{
+  if (self == NULL) return;
+
+  if (self->ptr != NULL) {
+    munmap(self->ptr, self->capacity);
+  }
+
+  self->fd = -1;
+  self->ptr = NULL;
+  self->size = 0;
+  self->capacity = 0;
+  self->offset = 0;
+  memset(&self->mode, 0, sizeof(self->mode));
+}
+
+/* Grow the file (and the mapping of it) to hold at least needed bytes. */
+static
+int
+memfd_cookie_reserve(struct memfd_cookie *self, size_t needed)
+{
+  int status = 0;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t capacity = self->capacity;
+  char *ptr = NULL;
+
+  if (needed <= capacity) {
+    goto cleanup;
+  }
+
+  capacity = capacity < SIZE_MAX / MEMFD_GROWTH ? capacity * MEMFD_GROWTH : SIZE_MAX;
+  if (capacity < needed) {
+    capacity = needed;
+  }
+
+  if (capacity > SIZE_MAX - page) {
+    status = -1;
+    errno = EFBIG;
+    goto cleanup;
+  }
+
+  capacity = (capacity + page - 1) & ~(page - 1);
+
+  status = ftruncate(self->fd, capacity);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+#ifdef HAVE_MREMAP
+  if (self->ptr == NULL) {
+    ptr = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
+  }
+  else {
+    ptr = mremap(self->ptr, self->capacity, capacity, MREMAP_MAYMOVE);
+  }
+
+  if (ptr == MAP_FAILED) {
+    status = -1;
+    goto cleanup;
+  }
+#else
+  /* The data lives in the memfd, so mapping it again carries it over. */
+  ptr = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
+  if (ptr == MAP_FAILED) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (self->ptr != NULL) {
+    munmap(self->ptr, self->capacity);
+  }
+#endif
+
+  self->ptr = ptr;
+  self->capacity = capacity;
+
+cleanup:
+  return status;
+}
+
+static
+ssize_t
+memfd_read(void *cookie, char *buf, size_t size)
+{
+  struct memfd_cookie *memfd_cookie = cookie;
+
+  size_t bytes_read = memfd_cookie->size - memfd_cookie->offset;
+
+  if (bytes_read > size) {
+    bytes_read = size;
+  }
+
+  if (bytes_read > 0) {
+    memcpy(buf, memfd_cookie->ptr + memfd_cookie->offset, bytes_read);
+  }
+
+  memfd_cookie->offset += bytes_read;
+
+  return bytes_read;
+}
+
+static
+ssize_t
+memfd_write(void *cookie, const char *buf, size_t size)
+{
+  int status = 0;
+  struct memfd_cookie *memfd_cookie = cookie;
+
+  int append = memfd_cookie->mode.append;
+  size_t start = append ? memfd_cookie->size : (size_t)memfd_cookie->offset;
+  size_t end = 0;
+
+  if (size > SIZE_MAX - start) {
+    errno = EFBIG;
+    return 0;
+  }
+
+  end = start + size;
+
+  status = memfd_cookie_reserve(memfd_cookie, end);
+  if (status != 0) {
+    /* A short write (rather than -1) makes stdio flag the error. */
+    return 0;
+  }
+
+  memcpy(memfd_cookie->ptr + start, buf, size);
+
+  if (memfd_cookie->size < end) {
+    memfd_cookie->size = end;
+  }
+
+  if (!append) {
+    memfd_cookie->offset = end;
+  }
+
+  return size;
+}
+
+static
+int
+memfd_seek(void *cookie, off64_t *offset, int whence)
+{
+  int status = 0;
+  struct memfd_cookie *memfd_cookie = cookie;
+  off_t new_offset = memfd_cookie->offset;
+
+  switch (whence) {
+    case SEEK_SET:
+      new_offset = *offset;
+      break;
+    case SEEK_CUR:
+      new_offset += *offset;
+      break;
+    case SEEK_END:
+      new_offset = memfd_cookie->size + *offset;
+      break;
+  }
+
+  if (new_offset < 0 || memfd_cookie->size < (size_t)new_offset) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+cleanup:
+  if (status == 0) {
+    memfd_cookie->offset = new_offset;
+    *offset = new_offset;
+  }
+
+  return status;
+}
+
+static
+void
+memfd_peek(struct ccstreams_stream *stream, const char **data, size_t *avail)
+{
+  struct memfd_cookie *memfd_cookie = (struct memfd_cookie *)stream;
+
+  *data = memfd_cookie->ptr + memfd_cookie->offset;
+  *avail = memfd_cookie->size - memfd_cookie->offset;
+}
+
+static const struct ccstreams_stream_ops memfd_stream_ops = {
+  .peek = memfd_peek,
+};
+
+static
+int
+memfd_close(void *cookie)
+{
+  int status = 0;
+  struct memfd_cookie *memfd_cookie = cookie;
+  int fd = memfd_cookie->fd;
+  int writable = memfd_cookie->mode.writable;
+  size_t size = memfd_cookie->size;
+
+  ccstreams_stream_unregister(&memfd_cookie->stream);
+
+  /* The writable mapping has to go before F_SEAL_WRITE is allowed. */
+  memfd_cookie_fini(memfd_cookie);
+  free(memfd_cookie);
+
+  if (!writable) {
+    goto cleanup;
+  }
+
+  status = ftruncate(fd, size);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+cleanup:
+  return status;
+}
+
+FILE *
+ccstreams_fmemfdopen(int *fd, const char *mode)
+{
+  assert(fd != NULL);
+  assert(mode != NULL);
+
+  int status = 0;
+  FILE *stream = NULL;
+  struct memfd_cookie *cookie = NULL;
+  cookie_io_functions_t memfd_io_funcs = {
+    .read  = memfd_read,
+    .write = memfd_write,
+    .seek  = memfd_seek,
+    .close = memfd_close,
+  };
+  struct ccstreams_mode parsed;
+  int created = 0;
+
+  ccstreams_mode_parse(&parsed, mode);
+
+  if ((*fd == -1) != parsed.writable) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  if (*fd == -1) {
+#ifdef HAVE_MEMFD_CREATE
+    *fd = memfd_create("ccstreams", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (*fd == -1) {
+      status = -1;
+      goto cleanup;
+    }
+
+    created = 1;
+#else
+    status = -1;
+    errno = ENOSYS;
+    goto cleanup;
+#endif
+  }
+
+  cookie = malloc(sizeof(*cookie));
+  if (cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = memfd_cookie_init(cookie, *fd, &parsed);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  stream = fopencookie(cookie, mode, memfd_io_funcs);
+  if (stream == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  ccstreams_stream_register(&cookie->stream, stream, CCSTREAMS_STREAM_MEMFD, &memfd_stream_ops);
+
+cleanup:
+  if (status != 0) {
+    int saved = errno;
+
+    if (cookie != NULL) {
+      memfd_cookie_fini(cookie);
+      free(cookie);
+    }
+
+    if (created) {
+      close(*fd);
+      *fd = -1;
+    }
+
+    errno = saved;
+  }
+
+  return stream;
+}
@@ -0,0 +1,62 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "mode.h"
+
+void
+ccstreams_mode_parse(struct ccstreams_mode *self, const char *mode)
+{
+  assert(self != NULL);
+  assert(mode != NULL);
+
+  size_t mode_length = strlen(mode);
+
+  memset(self, 0, sizeof(*self));
+
+  if (mode_length > 1) {
+    if (mode[1] == 'b') {
+      if (mode_length > 2 && mode[2] == '+') {
+        self->extra = 2;
+      }
+    }
+    else if (mode[1] == '+') {
+      self->extra = 1;
+    }
+  }
+
+  switch (mode[0]) {
+    case 'w':
+      if (self->extra) {
+        self->create = 1;
+      }
+      self->truncate = 1;
+      break;
+    case 'a':
+      if (!self->extra) {
+        self->end = 1;
+      }
+      self->create = 1;
+      self->append = 1;
+      break;
+  }
+
+  self->writable = mode[0] != 'r' || self->extra;
+}
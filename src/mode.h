@@ -0,0 +1,44 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_SRC_MODE_H
+#define CCSTREAMS_SRC_MODE_H 1
+
+/* Internal to the library: how the streams interpret the fopen(...) style
+ * mode they are opened with.
+ *
+ * extra:    '+' was given (the stream is opened for reading and writing).
+ * create:   A missing buffer is allocated ("w+", "a" and "a+").
+ * truncate: An existing buffer is emptied ("w" and "w+").
+ * append:   Output always goes to the end ("a" and "a+").
+ * end:      The stream starts positioned at the end ("a").
+ * writable: The stream is open for writing.
+ */
+struct ccstreams_mode {
+  int extra;
+  int create;
+  int truncate;
+  int append;
+  int end;
+  int writable;
+};
+
+void
+ccstreams_mode_parse(struct ccstreams_mode *self, const char *mode);
+
+#endif /* CCSTREAMS_SRC_MODE_H */
@@ -0,0 +1,88 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccstreams/peek.h>
+
+#include "stream.h"
+
+int
+ccstreams_peek(FILE *stream, const char **data, size_t *avail)
+{
+  assert(stream != NULL);
+  assert(data != NULL);
+  assert(avail != NULL);
+
+  int status = 0;
+  struct ccstreams_stream *found = ccstreams_stream_find(stream, CCSTREAMS_STREAM_ANY);
+
+  if (found == NULL || found->ops->peek == NULL) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  /* Lands pending output and moves the offset back over anything stdio has
+   * read ahead, so the offset is the position of the stream.
+   */
+  status = fflush(stream);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  found->ops->peek(found, data, avail);
+
+cleanup:
+  return status;
+}
+
+int
+ccstreams_consume(FILE *stream, size_t n)
+{
+  assert(stream != NULL);
+
+  int status = 0;
+  const char *data = NULL;
+  size_t avail = 0;
+
+  status = ccstreams_peek(stream, &data, &avail);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (n > avail) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  status = fseeko(stream, n, SEEK_CUR);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+cleanup:
+  return status;
+}
@@ -0,0 +1,352 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <ccstreams/pipe.h>
+
+/* The ring shared by the two ends. head is only advanced by the writer and
+ * tail only by the reader, so each side can publish its progress with a
+ * plain release store. The other side waits for a change on a futex
+ * sequence (written or drained), which is only bumped and woken when it has
+ * said it is waiting.
+ */
+struct pipe_ring {
+  char *data;
+  size_t capacity;
+  size_t head;
+  size_t tail;
+  uint32_t written;
+  uint32_t drained;
+  int reader_waiting;
+  int writer_waiting;
+  int reader_closed;
+  int writer_closed;
+  int nonblock;
+  int ends;
+};
+
+static
+void
+pipe_ring_wait(uint32_t *seq, uint32_t expected)
+{
+#ifdef HAVE_LINUX_FUTEX_H
+  /* Returns early on a change (EAGAIN) or a signal, the caller checks. */
+  syscall(SYS_futex, seq, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+#else
+  (void)seq;
+  (void)expected;
+  sched_yield();
+#endif
+}
+
+static
+void
+pipe_ring_wake(uint32_t *seq, int *waiting)
+{
+  __atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+#ifdef HAVE_LINUX_FUTEX_H
+    syscall(SYS_futex, seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+  }
+}
+
+/* Drop an end of the ring, freeing it with the last. */
+static
+void
+pipe_ring_release(struct pipe_ring *self)
+{
+  if (__atomic_sub_fetch(&self->ends, 1, __ATOMIC_ACQ_REL) == 0) {
+    free(self->data);
+    free(self);
+  }
+}
+
+static
+ssize_t
+pipe_read(void *cookie, char *buf, size_t size)
+{
+  struct pipe_ring *ring = cookie;
+
+  size_t tail = ring->tail;
+  size_t head = 0;
+  size_t avail = 0;
+  size_t offset = 0;
+  size_t first = 0;
+
+  for (;;) {
+    uint32_t seq = __atomic_load_n(&ring->written, __ATOMIC_SEQ_CST);
+
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head != tail) {
+      break;
+    }
+
+    if (__atomic_load_n(&ring->writer_closed, __ATOMIC_ACQUIRE)) {
+      /* The writer may have got more in just before closing. */
+      head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+      if (head != tail) {
+        break;
+      }
+
+      return 0;
+    }
+
+    if (ring->nonblock) {
+      errno = EAGAIN;
+      return -1;
+    }
+
+    __atomic_store_n(&ring->reader_waiting, 1, __ATOMIC_SEQ_CST);
+
+    /* Check again now the writer is bound to wake us. */
+    if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == tail &&
+        !__atomic_load_n(&ring->writer_closed, __ATOMIC_SEQ_CST)) {
+      pipe_ring_wait(&ring->written, seq);
+    }
+
+    __atomic_store_n(&ring->reader_waiting, 0, __ATOMIC_SEQ_CST);
+  }
+
+  avail = head - tail;
+  if (avail > size) {
+    avail = size;
+  }
+
+  offset = tail & (ring->capacity - 1);
+  first = ring->capacity - offset;
+  if (first > avail) {
+    first = avail;
+  }
+
+  memcpy(buf, ring->data + offset, first);
+  memcpy(buf + first, ring->data, avail - first);
+
+  __atomic_store_n(&ring->tail, tail + avail, __ATOMIC_RELEASE);
+  pipe_ring_wake(&ring->drained, &ring->writer_waiting);
+
+  return avail;
+}
+
+static
+ssize_t
+pipe_write(void *cookie, const char *buf, size_t size)
+{
+  struct pipe_ring *ring = cookie;
+
+  size_t head = ring->head;
+  size_t bytes_written = 0;
+
+  while (bytes_written < size) {
+    uint32_t seq = __atomic_load_n(&ring->drained, __ATOMIC_SEQ_CST);
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    size_t space = ring->capacity - (head - tail);
+    size_t offset = 0;
+    size_t first = 0;
+
+    if (__atomic_load_n(&ring->reader_closed, __ATOMIC_ACQUIRE)) {
+      errno = EPIPE;
+      break;
+    }
+
+    if (space == 0) {
+      if (ring->nonblock) {
+        errno = EAGAIN;
+        break;
+      }
+
+      __atomic_store_n(&ring->writer_waiting, 1, __ATOMIC_SEQ_CST);
+
+      if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == tail &&
+          !__atomic_load_n(&ring->reader_closed, __ATOMIC_SEQ_CST)) {
+        pipe_ring_wait(&ring->drained, seq);
+      }
+
+      __atomic_store_n(&ring->writer_waiting, 0, __ATOMIC_SEQ_CST);
+      continue;
+    }
+
+    if (space > size - bytes_written) {
+      space = size - bytes_written;
+    }
+
+    offset = head & (ring->capacity - 1);
+    first = ring->capacity - offset;
+    if (first > space) {
+      first = space;
+    }
+
+    memcpy(ring->data + offset, buf + bytes_written, first);
+    memcpy(ring->data, buf + bytes_written + first, space - first);
+
+    head += space;
+    bytes_written += space;
+
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    pipe_ring_wake(&ring->written, &ring->reader_waiting);
+  }
+
+  /* A short write (rather than -1) makes stdio flag the error. */
+  return bytes_written;
+}
+
+static
+int
+pipe_reader_close(void *cookie)
+{
+  struct pipe_ring *ring = cookie;
+
+  __atomic_store_n(&ring->reader_closed, 1, __ATOMIC_SEQ_CST);
+  pipe_ring_wake(&ring->drained, &ring->writer_waiting);
+  pipe_ring_release(ring);
+
+  return 0;
+}
+
+static
+int
+pipe_writer_close(void *cookie)
+{
+  struct pipe_ring *ring = cookie;
+
+  __atomic_store_n(&ring->writer_closed, 1, __ATOMIC_SEQ_CST);
+  pipe_ring_wake(&ring->written, &ring->reader_waiting);
+  pipe_ring_release(ring);
+
+  return 0;
+}
+
+int
+ccstreams_fpipeopen(FILE **reader, FILE **writer, size_t capacity, int flags)
+{
+  assert(reader != NULL);
+  assert(writer != NULL);
+
+  int status = 0;
+  struct pipe_ring *ring = NULL;
+  cookie_io_functions_t reader_io_funcs = {
+    .read  = pipe_read,
+    .write = NULL,
+    .seek  = NULL,
+    .close = pipe_reader_close,
+  };
+  cookie_io_functions_t writer_io_funcs = {
+    .read  = NULL,
+    .write = pipe_write,
+    .seek  = NULL,
+    .close = pipe_writer_close,
+  };
+  size_t rounded = 1;
+
+  *reader = NULL;
+  *writer = NULL;
+
+  if (capacity == 0) {
+    capacity = CCSTREAMS_PIPE_CAPACITY;
+  }
+
+  while (rounded < capacity) {
+    if (rounded > SIZE_MAX / 2) {
+      status = -1;
+      errno = EINVAL;
+      goto cleanup;
+    }
+
+    rounded *= 2;
+  }
+
+  ring = calloc(1, sizeof(*ring));
+  if (ring == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  ring->data = malloc(rounded);
+  if (ring->data == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  ring->capacity = rounded;
+  ring->nonblock = (flags & CCSTREAMS_PIPE_NONBLOCK) != 0;
+  ring->ends = 2;
+
+  *reader = fopencookie(ring, "r", reader_io_funcs);
+  if (*reader == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  *writer = fopencookie(ring, "w", writer_io_funcs);
+  if (*writer == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (ring->nonblock) {
+    status = setvbuf(*writer, NULL, _IONBF, 0);
+    if (status != 0) {
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+cleanup:
+  if (status != 0) {
+    int saved = errno;
+
+    /* Closing the ends that were opened releases the ring. */
+    if (ring != NULL && *writer == NULL) {
+      ring->ends = 1;
+    }
+
+    if (*writer != NULL) {
+      fclose(*writer);
+      *writer = NULL;
+    }
+
+    if (*reader != NULL) {
+      fclose(*reader);
+      *reader = NULL;
+      ring = NULL;
+    }
+
+    if (ring != NULL) {
+      free(ring->data);
+      free(ring);
+    }
+
+    errno = saved;
+  }
+
+  return status;
+}
@@ -0,0 +1,283 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccstreams/ring.h>
+
+#include "mode.h"
+#include "stream.h"
+
+/* head and tail count the bytes written and read since the stream was
+ * opened, so the data held is from the larger of tail and head - capacity
+ * up to head. Positions in the buffer are these counts modulo capacity.
+ */
+struct ring_cookie {
+  struct ccstreams_stream stream;
+  char *data;
+  size_t capacity;
+  uint64_t head;
+  uint64_t tail;
+};
+
+static
+int
+ring_cookie_init(struct ring_cookie *self, size_t capacity)
+{
+  int status = 0;
+
+  self->stream.file = NULL;
+  self->capacity = capacity;
+  self->head = 0;
+  self->tail = 0;
+
+  self->data = malloc(capacity);
+  if (self->data == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+cleanup:
+  return status;
+}
+
+static
+void
+ring_cookie_fini(struct ring_cookie *self)
+{
+  if (self == NULL) return;
+
+  free(self->data);
+
+  self->data = NULL;
+  self->capacity = 0;
+  self->head = 0;
+  self->tail = 0;
+}
+
+static
+struct ring_cookie *
+ring_cookie_find(FILE *stream)
+{
+  struct ccstreams_stream *found = ccstreams_stream_find(stream, CCSTREAMS_STREAM_RING);
+  if (found == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  return (struct ring_cookie *)found;
+}
+
+/* Skip the tail over data that has been overwritten. */
+static
+void
+ring_cookie_settle(struct ring_cookie *self)
+{
+  if (self->head - self->tail > self->capacity) {
+    self->tail = self->head - self->capacity;
+  }
+}
+
+static
+ssize_t
+ring_read(void *cookie, char *buf, size_t size)
+{
+  struct ring_cookie *ring_cookie = cookie;
+
+  size_t avail = 0;
+  size_t offset = 0;
+  size_t first = 0;
+
+  ring_cookie_settle(ring_cookie);
+
+  avail = ring_cookie->head - ring_cookie->tail;
+  if (avail > size) {
+    avail = size;
+  }
+
+  offset = ring_cookie->tail % ring_cookie->capacity;
+  first = ring_cookie->capacity - offset;
+  if (first > avail) {
+    first = avail;
+  }
+
+  memcpy(buf, ring_cookie->data + offset, first);
+  memcpy(buf + first, ring_cookie->data, avail - first);
+  ring_cookie->tail += avail;
+
+  return avail;
+}
+
+static
+ssize_t
+ring_write(void *cookie, const char *buf, size_t size)
+{
+  struct ring_cookie *ring_cookie = cookie;
+
+  size_t kept = size;
+  uint64_t start = ring_cookie->head;
+  size_t offset = 0;
+  size_t first = 0;
+
+  /* Only the end of a write larger than the buffer would survive it. */
+  if (kept > ring_cookie->capacity) {
+    kept = ring_cookie->capacity;
+    start += size - kept;
+    buf += size - kept;
+  }
+
+  offset = start % ring_cookie->capacity;
+  first = ring_cookie->capacity - offset;
+  if (first > kept) {
+    first = kept;
+  }
+
+  memcpy(ring_cookie->data + offset, buf, first);
+  memcpy(ring_cookie->data, buf + first, kept - first);
+  ring_cookie->head += size;
+
+  return size;
+}
+
+/* Not seekable, as for a pipe (stdio ignores ESPIPE when flushing). */
+static
+int
+ring_seek(void *cookie, off64_t *offset, int whence)
+{
+  errno = ESPIPE;
+  return -1;
+}
+
+/* Registered only to be found again: the data isn't contiguous. */
+static const struct ccstreams_stream_ops ring_stream_ops = {
+  .peek = NULL,
+};
+
+static
+int
+ring_close(void *cookie)
+{
+  struct ring_cookie *ring_cookie = cookie;
+
+  ccstreams_stream_unregister(&ring_cookie->stream);
+  ring_cookie_fini(ring_cookie);
+  free(ring_cookie);
+
+  return 0;
+}
+
+FILE *
+ccstreams_fringopen(size_t capacity, const char *mode)
+{
+  assert(mode != NULL);
+
+  int status = 0;
+  FILE *stream = NULL;
+  struct ring_cookie *cookie = NULL;
+  cookie_io_functions_t ring_io_funcs = {
+    .read  = ring_read,
+    .write = ring_write,
+    .seek  = ring_seek,
+    .close = ring_close,
+  };
+  struct ccstreams_mode parsed;
+
+  ccstreams_mode_parse(&parsed, mode);
+
+  if (capacity == 0 || !parsed.writable) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  cookie = malloc(sizeof(*cookie));
+  if (cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = ring_cookie_init(cookie, capacity);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  stream = fopencookie(cookie, mode, ring_io_funcs);
+  if (stream == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  ccstreams_stream_register(&cookie->stream, stream, CCSTREAMS_STREAM_RING, &ring_stream_ops);
+
+cleanup:
+  if (status != 0) {
+    if (cookie != NULL) {
+      ring_cookie_fini(cookie);
+      free(cookie);
+    }
+  }
+
+  return stream;
+}
+
+int
+ccstreams_ring_snapshot(FILE *stream, struct iovec segments[2])
+{
+  assert(stream != NULL);
+  assert(segments != NULL);
+
+  int status = 0;
+  struct ring_cookie *ring_cookie = NULL;
+  size_t avail = 0;
+  size_t offset = 0;
+  size_t first = 0;
+
+  ring_cookie = ring_cookie_find(stream);
+  if (ring_cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = fflush(stream);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  ring_cookie_settle(ring_cookie);
+
+  avail = ring_cookie->head - ring_cookie->tail;
+  offset = ring_cookie->tail % ring_cookie->capacity;
+  first = ring_cookie->capacity - offset;
+  if (first > avail) {
+    first = avail;
+  }
+
+  segments[0].iov_base = ring_cookie->data + offset;
+  segments[0].iov_len = first;
+  segments[1].iov_base = ring_cookie->data;
+  segments[1].iov_len = avail - first;
+
+cleanup:
+  return status;
+}
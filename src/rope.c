@@ -0,0 +1,663 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "mode.h"
+#include "rope.h"
+#include "stream.h"
+
+/* Size of the chunks when none is given. */
+#define ROPE_CHUNK (1024 * 1024)
+
+struct rope_chunk {
+  char *data;
+  size_t start;
+  size_t size;
+  size_t capacity;
+};
+
+struct rope_cookie {
+  struct ccstreams_stream stream;
+  struct ccstreams_allocator allocator;
+  char **ptr;
+  size_t *size;
+  size_t *allocated;
+  struct iovec **rest;
+  size_t *rest_count;
+  int flatten;
+  struct rope_chunk *chunks;
+  size_t count;
+  size_t slots;
+  size_t chunk;
+  size_t cursor;
+  off_t offset;
+  struct ccstreams_mode mode;
+};
+
+static
+int
+rope_cookie_init(struct rope_cookie *self, const struct ccstreams_allocator *allocator, const struct ccstreams_mode *mode, char **ptr, size_t *size, const struct ccstreams_mem_options *options)
+{
+  assert(ptr != NULL);
+  assert(*ptr != NULL);
+  assert(size != NULL);
+
+  int status = 0;
+
+  self->stream.file = NULL;
+  self->allocator = *allocator;
+  self->ptr = ptr;
+  self->size = size;
+  self->allocated = options->allocated;
+  self->rest = options->chunks;
+  self->rest_count = options->chunk_count;
+  self->flatten = (options->flags & CCSTREAMS_MEM_FLATTEN) != 0;
+  self->chunks = NULL;
+  self->count = 0;
+  self->slots = 0;
+  self->chunk = options->chunk > 0 ? options->chunk : ROPE_CHUNK;
+  self->cursor = 0;
+  self->offset = 0;
+  self->mode = *mode;
+
+  /* The buffer we were given is the first chunk. */
+  self->chunks = self->allocator.alloc(self->allocator.context, sizeof(*self->chunks));
+  if (self->chunks == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  self->chunks[0].data = *ptr;
+  self->chunks[0].start = 0;
+  self->chunks[0].size = *size;
+  self->chunks[0].capacity = *size;
+  self->count = 1;
+  self->slots = 1;
+
+  if (self->allocated != NULL) {
+    *self->allocated = *size;
+  }
+
+cleanup:
+  return status;
+}
+
+static
+void
+rope_cookie_fini(struct rope_cookie *self)
+{
+  if (self == NULL) return;
+
+  if (self->chunks != NULL) {
+    self->allocator.free(self->allocator.context, self->chunks, self->slots * sizeof(*self->chunks));
+  }
+
+  self->ptr = NULL;
+  self->size = NULL;
+  self->allocated = NULL;
+  self->rest = NULL;
+  self->rest_count = NULL;
+  self->flatten = 0;
+  self->chunks = NULL;
+  self->count = 0;
+  self->slots = 0;
+  self->chunk = 0;
+  self->cursor = 0;
+  self->offset = 0;
+  memset(&self->mode, 0, sizeof(self->mode));
+}
+
+/* The index of the chunk holding offset (which must be before the end).
+ * Access is usually sequential, so the last chunk found is tried first.
+ */
+static
+size_t
+rope_cookie_locate(struct rope_cookie *self, size_t offset)
+{
+  size_t low = 0;
+  size_t high = self->count;
+  struct rope_chunk *chunk = NULL;
+
+  assert(offset < *self->size);
+
+  if (self->cursor < self->count) {
+    chunk = &self->chunks[self->cursor];
+    if (offset >= chunk->start && offset < chunk->start + chunk->size) {
+      return self->cursor;
+    }
+
+    if (self->cursor + 1 < self->count) {
+      chunk++;
+      if (offset >= chunk->start && offset < chunk->start + chunk->size) {
+        return ++self->cursor;
+      }
+    }
+  }
+
+  while (high - low > 1) {
+    size_t middle = low + (high - low) / 2;
+    if (self->chunks[middle].start <= offset) {
+      low = middle;
+    }
+    else {
+      high = middle;
+    }
+  }
+
+  /* Skip over empty chunks (only the first can be). */
+  while (self->chunks[low].start + self->chunks[low].size <= offset) {
+    low++;
+  }
+
+  return self->cursor = low;
+}
+
+/* Add an empty chunk of at least needed bytes at the end. */
+static
+int
+rope_cookie_extend(struct rope_cookie *self, size_t needed)
+{
+  int status = 0;
+  struct rope_chunk *chunk = NULL;
+  char *data = NULL;
+  size_t capacity = needed > self->chunk ? needed : self->chunk;
+
+  if (self->count == self->slots) {
+    size_t slots = self->slots * 2;
+    struct rope_chunk *chunks = NULL;
+
+    chunks = self->allocator.grow(self->allocator.context, self->chunks,
+                                  self->slots * sizeof(*chunks), slots * sizeof(*chunks));
+    if (chunks == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+
+    self->chunks = chunks;
+    self->slots = slots;
+  }
+
+  data = self->allocator.alloc(self->allocator.context, capacity);
+  if (data == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  chunk = &self->chunks[self->count++];
+  chunk->data = data;
+  chunk->start = *self->size;
+  chunk->size = 0;
+  chunk->capacity = capacity;
+
+cleanup:
+  return status;
+}
+
+/* Gather the chunks into a single buffer of exactly *size bytes at *ptr.
+ * Each chunk is released as soon as it has been copied, so the data is only
+ * held twice a chunk at a time (pages of the new buffer are only backed as
+ * they are written).
+ */
+static
+int
+rope_cookie_flatten(struct rope_cookie *self)
+{
+  int status = 0;
+  struct rope_chunk *first = &self->chunks[0];
+  char *data = NULL;
+  size_t i = 0;
+
+  /* Only chunks after the first have room to spare. */
+  if (self->count == 1) {
+    *self->ptr = first->data;
+    goto cleanup;
+  }
+
+  data = self->allocator.alloc(self->allocator.context, *self->size);
+  if (data == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  for (i = 0; i < self->count; i++) {
+    struct rope_chunk *chunk = &self->chunks[i];
+
+    memcpy(data + chunk->start, chunk->data, chunk->size);
+    self->allocator.free(self->allocator.context, chunk->data, chunk->capacity);
+  }
+
+  first->data = data;
+  first->start = 0;
+  first->size = *self->size;
+  first->capacity = *self->size;
+  self->count = 1;
+  self->cursor = 0;
+
+  *self->ptr = data;
+  if (self->allocated != NULL) {
+    *self->allocated = *self->size;
+  }
+
+cleanup:
+  return status;
+}
+
+/* Hand the chunks after the first to the caller (in *rest) and leave *ptr
+ * and *size describing the first. The last chunk is shrunk to fit so that
+ * each segment can be freed with its length (the others are always full).
+ * On failure the chunks are left as they were.
+ */
+static
+int
+rope_cookie_hand_back(struct rope_cookie *self)
+{
+  int status = 0;
+  struct rope_chunk *first = &self->chunks[0];
+  struct rope_chunk *last = &self->chunks[self->count - 1];
+  struct iovec *rest = NULL;
+  size_t n = self->count - 1;
+  size_t i = 0;
+
+  *self->rest = NULL;
+  *self->rest_count = 0;
+
+  if (n == 0) {
+    goto cleanup;
+  }
+
+  rest = self->allocator.alloc(self->allocator.context, n * sizeof(*rest));
+  if (rest == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (last->size < last->capacity) {
+    char *data = self->allocator.grow(self->allocator.context, last->data, last->capacity, last->size);
+    if (data == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+
+    last->data = data;
+    last->capacity = last->size;
+  }
+
+  /* Chunks are only added to be written to, so none of these is empty. */
+  for (i = 0; i < n; i++) {
+    rest[i].iov_base = self->chunks[i + 1].data;
+    rest[i].iov_len = self->chunks[i + 1].size;
+  }
+
+  *self->rest = rest;
+  *self->rest_count = n;
+  rest = NULL;
+
+  self->count = 1;
+  self->cursor = 0;
+  *self->ptr = first->data;
+  *self->size = first->size;
+  if (self->allocated != NULL) {
+    *self->allocated = first->capacity;
+  }
+
+cleanup:
+  if (rest != NULL) {
+    self->allocator.free(self->allocator.context, rest, n * sizeof(*rest));
+  }
+
+  return status;
+}
+
+static
+ssize_t
+rope_read(void *cookie, char *buf, size_t size)
+{
+  struct rope_cookie *rope_cookie = cookie;
+
+  size_t bytes_read = 0;
+
+  while (bytes_read < size && (size_t)rope_cookie->offset < *rope_cookie->size) {
+    size_t index = rope_cookie_locate(rope_cookie, rope_cookie->offset);
+    struct rope_chunk *chunk = &rope_cookie->chunks[index];
+    size_t inner = rope_cookie->offset - chunk->start;
+    size_t n = chunk->size - inner;
+
+    if (n > size - bytes_read) {
+      n = size - bytes_read;
+    }
+
+    memcpy(buf + bytes_read, chunk->data + inner, n);
+    bytes_read += n;
+    rope_cookie->offset += n;
+  }
+
+  return bytes_read;
+}
+
+static
+ssize_t
+rope_write(void *cookie, const char *buf, size_t size)
+{
+  int status = 0;
+  struct rope_cookie *rope_cookie = cookie;
+
+  int append = rope_cookie->mode.append;
+  size_t start = append ? *rope_cookie->size : (size_t)rope_cookie->offset;
+  size_t bytes_written = 0;
+
+  /* Overwrite what is already there. */
+  while (bytes_written < size && start + bytes_written < *rope_cookie->size) {
+    size_t index = rope_cookie_locate(rope_cookie, start + bytes_written);
+    struct rope_chunk *chunk = &rope_cookie->chunks[index];
+    size_t inner = start + bytes_written - chunk->start;
+    size_t n = chunk->size - inner;
+
+    if (n > size - bytes_written) {
+      n = size - bytes_written;
+    }
+
+    memcpy(chunk->data + inner, buf + bytes_written, n);
+    bytes_written += n;
+  }
+
+  /* Then add to the end, a chunk at a time. */
+  while (bytes_written < size) {
+    struct rope_chunk *last = &rope_cookie->chunks[rope_cookie->count - 1];
+    size_t n = last->capacity - last->size;
+
+    if (n == 0) {
+      status = rope_cookie_extend(rope_cookie, 0);
+      if (status != 0) {
+        status = -1;
+        break;
+      }
+
+      continue;
+    }
+
+    if (n > size - bytes_written) {
+      n = size - bytes_written;
+    }
+
+    memcpy(last->data + last->size, buf + bytes_written, n);
+    last->size += n;
+    *rope_cookie->size += n;
+    bytes_written += n;
+  }
+
+  if (!append) {
+    rope_cookie->offset = start + bytes_written;
+  }
+
+  /* A short write (rather than -1) makes stdio flag the error. */
+  return bytes_written;
+}
+
+static
+int
+rope_seek(void *cookie, off64_t *offset, int whence)
+{
+  int status = 0;
+  struct rope_cookie *rope_cookie = cookie;
+  off_t new_offset = rope_cookie->offset;
+
+  switch (whence) {
+    case SEEK_SET:
+      new_offset = *offset;
+      break;
+    case SEEK_CUR:
+      new_offset += *offset;
+      break;
+    case SEEK_END:
+      new_offset = *rope_cookie->size + *offset;
+      break;
+  }
+
+  if (new_offset < 0 || *rope_cookie->size < (size_t)new_offset) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+cleanup:
+  if (status == 0) {
+    rope_cookie->offset = new_offset;
+    *offset = new_offset;
+  }
+
+  return status;
+}
+
+static
+void
+rope_peek(struct ccstreams_stream *stream, const char **data, size_t *avail)
+{
+  struct rope_cookie *rope_cookie = (struct rope_cookie *)stream;
+  struct rope_chunk *chunk = NULL;
+  size_t inner = 0;
+
+  if ((size_t)rope_cookie->offset == *rope_cookie->size) {
+    chunk = &rope_cookie->chunks[rope_cookie->count - 1];
+    *data = chunk->data + chunk->size;
+    *avail = 0;
+    return;
+  }
+
+  chunk = &rope_cookie->chunks[rope_cookie_locate(rope_cookie, rope_cookie->offset)];
+  inner = rope_cookie->offset - chunk->start;
+
+  *data = chunk->data + inner;
+  *avail = chunk->size - inner;
+}
+
+static
+void
+rope_iov(struct ccstreams_stream *stream, struct iovec *iov, size_t *count)
+{
+  struct rope_cookie *rope_cookie = (struct rope_cookie *)stream;
+  size_t i = 0;
+  size_t n = 0;
+
+  for (i = 0; i < rope_cookie->count; i++) {
+    struct rope_chunk *chunk = &rope_cookie->chunks[i];
+
+    if (chunk->size == 0) {
+      continue;
+    }
+
+    if (n < *count) {
+      iov[n].iov_base = chunk->data;
+      iov[n].iov_len = chunk->size;
+    }
+
+    n++;
+  }
+
+  *count = n;
+}
+
+static
+int
+rope_flatten(struct ccstreams_stream *stream)
+{
+  return rope_cookie_flatten((struct rope_cookie *)stream);
+}
+
+static const struct ccstreams_stream_ops rope_stream_ops = {
+  .peek = rope_peek,
+  .iov = rope_iov,
+  .flatten = rope_flatten,
+};
+
+static
+int
+rope_close(void *cookie)
+{
+  int status = 0;
+  struct rope_cookie *rope_cookie = cookie;
+  struct ccstreams_allocator allocator = rope_cookie->allocator;
+
+  ccstreams_stream_unregister(&rope_cookie->stream);
+
+  /* Gathering is only done when asked for. Whatever isn't gathered into *ptr
+   * is handed back as is.
+   */
+  if (rope_cookie->flatten) {
+    status = rope_cookie_flatten(rope_cookie);
+    if (status != 0) {
+      status = -1;
+    }
+  }
+
+  if (rope_cookie_hand_back(rope_cookie) != 0) {
+    struct rope_chunk *first = &rope_cookie->chunks[0];
+
+    /* The chunks after the first can't be handed back. They are left
+     * allocated rather than freed with the data in them. *ptr and *size
+     * describe the first chunk (which is always exactly full).
+     */
+    status = -1;
+    *rope_cookie->ptr = first->data;
+    *rope_cookie->size = first->size;
+  }
+
+  rope_cookie_fini(rope_cookie);
+  allocator.free(allocator.context, rope_cookie, sizeof(*rope_cookie));
+
+  return status;
+}
+
+FILE *
+ccstreams_rope_open(char **ptr, size_t *size, const char *mode,
+                    const struct ccstreams_mem_options *options)
+{
+  assert(ptr != NULL);
+  assert(size != NULL);
+  assert(options != NULL);
+
+  int status = 0;
+  FILE *stream = NULL;
+  struct rope_cookie *cookie = NULL;
+  cookie_io_functions_t rope_io_funcs = {
+    .read  = rope_read,
+    .write = rope_write,
+    .seek  = rope_seek,
+    .close = rope_close,
+  };
+  struct ccstreams_mode parsed;
+  int created = 0;
+  const struct ccstreams_allocator *allocator = options->allocator;
+
+  if (allocator == NULL) {
+    allocator = &ccstreams_allocator_default;
+  }
+
+  /* The chunks need somewhere to go when the stream is closed. */
+  if (options->chunks == NULL || options->chunk_count == NULL) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  ccstreams_mode_parse(&parsed, mode);
+
+  if (parsed.create && *ptr == NULL) {
+    *ptr = allocator->alloc(allocator->context, 0);
+    if (*ptr == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+
+    created = 1;
+    *size = 0;
+  }
+
+  if (*ptr == NULL) {
+    status = -1;
+    errno = ENOENT;
+    goto cleanup;
+  }
+
+  if (parsed.truncate && !created) {
+    char *empty = allocator->alloc(allocator->context, 0);
+    if (empty == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+
+    allocator->free(allocator->context, *ptr, *size);
+    *ptr = empty;
+    *size = 0;
+  }
+
+  cookie = allocator->alloc(allocator->context, sizeof(*cookie));
+  if (cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = rope_cookie_init(cookie, allocator, &parsed, ptr, size, options);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  stream = fopencookie(cookie, mode, rope_io_funcs);
+  if (stream == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  ccstreams_stream_register(&cookie->stream, stream, CCSTREAMS_STREAM_ROPE, &rope_stream_ops);
+
+  if (parsed.end) {
+    status = fseek(stream, 0, SEEK_END);
+    if (status != 0) {
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+cleanup:
+  if (status != 0) {
+    if (stream != NULL) {
+      /* Closing the stream releases the cookie. */
+      fclose(stream);
+      stream = NULL;
+      cookie = NULL;
+    }
+
+    if (cookie != NULL) {
+      rope_cookie_fini(cookie);
+      allocator->free(allocator->context, cookie, sizeof(*cookie));
+    }
+
+    if (created) {
+      allocator->free(allocator->context, *ptr, *size);
+      *ptr = NULL;
+    }
+  }
+
+  return stream;
+}
@@ -0,0 +1,35 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_SRC_ROPE_H
+#define CCSTREAMS_SRC_ROPE_H 1
+
+#include <ccstreams/mem.h>
+
+/* Internal to the library: the chunked mem stream behind
+ * ccstreams_fmemopen_options(...) with CCSTREAMS_MEM_CHUNKED. The data is
+ * kept in a list of chunks rather than one buffer, so growing it never moves
+ * what has been written. It is gathered into *ptr by ccstreams_mem_flatten()
+ * (and on close with CCSTREAMS_MEM_FLATTEN), otherwise the chunks are handed
+ * back on close.
+ */
+FILE *
+ccstreams_rope_open(char **ptr, size_t *size, const char *mode,
+                    const struct ccstreams_mem_options *options);
+
+#endif /* CCSTREAMS_SRC_ROPE_H */
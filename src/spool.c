@@ -0,0 +1,469 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ccstreams/spool.h>
+
+#include "alloc.h"
+#include "mode.h"
+#include "stream.h"
+
+/* The factor by which the buffer grows while in memory. */
+#define SPOOL_GROWTH 2
+
+struct spool_cookie {
+  struct ccstreams_stream stream;
+  struct ccstreams_allocator allocator;
+  char *ptr;
+  size_t size;
+  size_t capacity;
+  size_t threshold;
+  const char *directory;
+  int fd;
+  off_t offset;
+  struct ccstreams_mode mode;
+};
+
+static
+void
+spool_cookie_init(struct spool_cookie *self, const struct ccstreams_allocator *allocator, const struct ccstreams_mode *mode, const size_t threshold, const char *directory)
+{
+  self->stream.file = NULL;
+  self->allocator = *allocator;
+  self->ptr = NULL;
+  self->size = 0;
+  self->capacity = 0;
+  self->threshold = threshold > 0 ? threshold : CCSTREAMS_SPOOL_THRESHOLD;
+  self->directory = directory;
+  self->fd = -1;
+  self->offset = 0;
+  self->mode = *mode;
+}
+
+static
+void
+spool_cookie_fini(struct spool_cookie *self)
+{
+  if (self == NULL) return;
+
+  if (self->ptr != NULL) {
+    self->allocator.free(self->allocator.context, self->ptr, self->capacity);
+  }
+
+  if (self->fd != -1) {
+    close(self->fd);
+  }
+
+  self->ptr = NULL;
+  self->size = 0;
+  self->capacity = 0;
+  self->threshold = 0;
+  self->directory = NULL;
+  self->fd = -1;
+  self->offset = 0;
+  memset(&self->mode, 0, sizeof(self->mode));
+}
+
+static
+struct spool_cookie *
+spool_cookie_find(FILE *stream)
+{
+  struct ccstreams_stream *found = ccstreams_stream_find(stream, CCSTREAMS_STREAM_SPOOL);
+  if (found == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  return (struct spool_cookie *)found;
+}
+
+/* Write all of buf at offset, retrying short writes. */
+static
+int
+spool_pwrite(int fd, const char *buf, size_t size, off_t offset)
+{
+  while (size > 0) {
+    ssize_t written = pwrite(fd, buf, size, offset);
+    if (written == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+
+    buf += written;
+    size -= written;
+    offset += written;
+  }
+
+  return 0;
+}
+
+/* Open an anonymous file in the directory. */
+static
+int
+spool_tmpfile(const char *directory)
+{
+  int fd = -1;
+  size_t length = 0;
+  char *path = NULL;
+
+  if (directory == NULL) {
+    directory = getenv("TMPDIR");
+  }
+
+  if (directory == NULL || directory[0] == '\0') {
+    directory = "/tmp";
+  }
+
+#ifdef O_TMPFILE
+  fd = open(directory, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (fd != -1 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL)) {
+    return fd;
+  }
+#endif
+
+  length = strlen(directory) + sizeof("/ccstreams-spool-XXXXXX");
+  path = malloc(length);
+  if (path == NULL) {
+    return -1;
+  }
+
+  snprintf(path, length, "%s/ccstreams-spool-XXXXXX", directory);
+
+  fd = mkostemp(path, O_CLOEXEC);
+  if (fd != -1) {
+    unlink(path);
+  }
+
+  free(path);
+
+  return fd;
+}
+
+/* Move the data out of memory into a temporary file. */
+static
+int
+spool_cookie_spill(struct spool_cookie *self)
+{
+  int status = 0;
+  int fd = -1;
+
+  fd = spool_tmpfile(self->directory);
+  if (fd == -1) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = spool_pwrite(fd, self->ptr, self->size, 0);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (self->ptr != NULL) {
+    self->allocator.free(self->allocator.context, self->ptr, self->capacity);
+  }
+
+  self->ptr = NULL;
+  self->capacity = 0;
+  self->fd = fd;
+  fd = -1;
+
+cleanup:
+  if (fd != -1) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+  }
+
+  return status;
+}
+
+/* Make room in memory for needed bytes. */
+static
+int
+spool_cookie_reserve(struct spool_cookie *self, size_t needed)
+{
+  int status = 0;
+  size_t capacity = self->capacity;
+  char *ptr = NULL;
+
+  if (needed <= capacity) {
+    goto cleanup;
+  }
+
+  capacity = capacity < SIZE_MAX / SPOOL_GROWTH ? capacity * SPOOL_GROWTH : SIZE_MAX;
+  if (capacity < needed) {
+    capacity = needed;
+  }
+
+  /* Everything up to the threshold at most, as beyond it the data moves. */
+  if (capacity > self->threshold) {
+    capacity = self->threshold;
+  }
+
+  if (self->ptr == NULL) {
+    ptr = self->allocator.alloc(self->allocator.context, capacity);
+  }
+  else {
+    ptr = self->allocator.grow(self->allocator.context, self->ptr, self->capacity, capacity);
+  }
+
+  if (ptr == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  self->ptr = ptr;
+  self->capacity = capacity;
+
+cleanup:
+  return status;
+}
+
+static
+ssize_t
+spool_read(void *cookie, char *buf, size_t size)
+{
+  struct spool_cookie *spool_cookie = cookie;
+
+  ssize_t bytes_read = spool_cookie->size - spool_cookie->offset;
+
+  if ((size_t)bytes_read > size) {
+    bytes_read = size;
+  }
+
+  if (spool_cookie->fd == -1) {
+    memcpy(buf, spool_cookie->ptr + spool_cookie->offset, bytes_read);
+  }
+  else {
+    do {
+      bytes_read = pread(spool_cookie->fd, buf, bytes_read, spool_cookie->offset);
+    } while (bytes_read == -1 && errno == EINTR);
+
+    if (bytes_read == -1) {
+      return -1;
+    }
+  }
+
+  spool_cookie->offset += bytes_read;
+
+  return bytes_read;
+}
+
+static
+ssize_t
+spool_write(void *cookie, const char *buf, size_t size)
+{
+  int status = 0;
+  struct spool_cookie *spool_cookie = cookie;
+
+  int append = spool_cookie->mode.append;
+  size_t start = append ? spool_cookie->size : (size_t)spool_cookie->offset;
+  size_t end = 0;
+
+  if (size > SIZE_MAX - start) {
+    errno = EFBIG;
+    return 0;
+  }
+
+  end = start + size;
+
+  if (spool_cookie->fd == -1 && end > spool_cookie->threshold) {
+    status = spool_cookie_spill(spool_cookie);
+    if (status != 0) {
+      /* A short write (rather than -1) makes stdio flag the error. */
+      return 0;
+    }
+  }
+
+  if (spool_cookie->fd == -1) {
+    status = spool_cookie_reserve(spool_cookie, end);
+    if (status != 0) {
+      return 0;
+    }
+
+    memcpy(spool_cookie->ptr + start, buf, size);
+  }
+  else {
+    status = spool_pwrite(spool_cookie->fd, buf, size, start);
+    if (status != 0) {
+      return 0;
+    }
+  }
+
+  if (spool_cookie->size < end) {
+    spool_cookie->size = end;
+  }
+
+  if (!append) {
+    spool_cookie->offset = end;
+  }
+
+  return size;
+}
+
+static
+int
+spool_seek(void *cookie, off64_t *offset, int whence)
+{
+  int status = 0;
+  struct spool_cookie *spool_cookie = cookie;
+  off_t new_offset = spool_cookie->offset;
+
+  switch (whence) {
+    case SEEK_SET:
+      new_offset = *offset;
+      break;
+    case SEEK_CUR:
+      new_offset += *offset;
+      break;
+    case SEEK_END:
+      new_offset = spool_cookie->size + *offset;
+      break;
+  }
+
+  if (new_offset < 0 || spool_cookie->size < (size_t)new_offset) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+cleanup:
+  if (status == 0) {
+    spool_cookie->offset = new_offset;
+    *offset = new_offset;
+  }
+
+  return status;
+}
+
+/* Registered only to be found again: the data may not be in memory to
+ * peek at.
+ */
+static const struct ccstreams_stream_ops spool_stream_ops = {
+  .peek = NULL,
+};
+
+static
+int
+spool_close(void *cookie)
+{
+  struct spool_cookie *spool_cookie = cookie;
+  struct ccstreams_allocator allocator = spool_cookie->allocator;
+
+  ccstreams_stream_unregister(&spool_cookie->stream);
+  spool_cookie_fini(spool_cookie);
+  allocator.free(allocator.context, spool_cookie, sizeof(*spool_cookie));
+
+  return 0;
+}
+
+FILE *
+ccstreams_fspoolopen(const char *mode, const struct ccstreams_spool_options *options)
+{
+  assert(mode != NULL);
+
+  static const struct ccstreams_spool_options defaults = {
+    .threshold = CCSTREAMS_SPOOL_THRESHOLD,
+    .directory = NULL,
+    .allocator = NULL,
+  };
+
+  int status = 0;
+  FILE *stream = NULL;
+  struct spool_cookie *cookie = NULL;
+  cookie_io_functions_t spool_io_funcs = {
+    .read  = spool_read,
+    .write = spool_write,
+    .seek  = spool_seek,
+    .close = spool_close,
+  };
+  struct ccstreams_mode parsed;
+  const struct ccstreams_allocator *allocator = NULL;
+
+  if (options == NULL) {
+    options = &defaults;
+  }
+
+  allocator = options->allocator;
+  if (allocator == NULL) {
+    allocator = &ccstreams_allocator_default;
+  }
+
+  ccstreams_mode_parse(&parsed, mode);
+
+  cookie = allocator->alloc(allocator->context, sizeof(*cookie));
+  if (cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  spool_cookie_init(cookie, allocator, &parsed, options->threshold, options->directory);
+
+  stream = fopencookie(cookie, mode, spool_io_funcs);
+  if (stream == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  ccstreams_stream_register(&cookie->stream, stream, CCSTREAMS_STREAM_SPOOL, &spool_stream_ops);
+
+cleanup:
+  if (status != 0) {
+    if (cookie != NULL) {
+      spool_cookie_fini(cookie);
+      allocator->free(allocator->context, cookie, sizeof(*cookie));
+    }
+  }
+
+  return stream;
+}
+
+int
+ccstreams_spool_fd(FILE *stream, int *fd)
+{
+  assert(stream != NULL);
+  assert(fd != NULL);
+
+  int status = 0;
+  struct spool_cookie *spool_cookie = NULL;
+
+  spool_cookie = spool_cookie_find(stream);
+  if (spool_cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = fflush(stream);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  *fd = spool_cookie->fd;
+
+cleanup:
+  return status;
+}
@@ -18,31 +18,56 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <ccstreams/str.h>
 
+#include "alloc.h"
+#include "mode.h"
+#include "stream.h"
+
 struct str_cookie {
+  struct ccstreams_stream stream;
+  struct ccstreams_allocator allocator;
   char **str;
+  char *buffer;
   size_t length;
+  size_t capacity;
+  size_t *length_out;
+  size_t *capacity_out;
+  double growth;
   off_t offset;
-  int append;
+  struct ccstreams_mode mode;
+  int defer;
+  int lazy;
+  char empty[1];
 };
 
 static
 int
-str_cookie_init(struct str_cookie *self, char **str, const int append)
+str_cookie_init(struct str_cookie *self, const struct ccstreams_allocator *allocator, char **str, const size_t length, const size_t capacity, const struct ccstreams_str_options *options, const struct ccstreams_mode *mode)
 {
   assert(str != NULL);
-  assert(*str != NULL);
+  assert(*str != NULL || length == 0);
+  assert(length < capacity);
 
   int status = 0;
 
+  self->stream.file = NULL;
+  self->allocator = *allocator;
   self->str = str;
-  self->length = strlen(*str);
+  self->buffer = *str;
+  self->length = length;
+  self->capacity = capacity;
+  self->length_out = options->length;
+  self->capacity_out = options->capacity;
+  self->growth = options->growth > 1 ? options->growth : CCSTREAMS_STR_GROWTH;
   self->offset = 0;
-  self->append = append;
+  self->mode = *mode;
+  self->defer = options->flags & CCSTREAMS_STR_LAZY;
+  self->lazy = 0;
 
   return 0;
 }
@@ -54,9 +79,165 @@ str_cookie_fini(struct str_cookie *self)
   if (self == NULL) return;
 
   self->str = NULL;
+  self->buffer = NULL;
   self->length = 0;
+  self->capacity = 0;
+  self->length_out = NULL;
+  self->capacity_out = NULL;
+  self->growth = 0;
   self->offset = 0;
-  self->append = 0;
+  memset(&self->mode, 0, sizeof(self->mode));
+  self->defer = 0;
+  self->lazy = 0;
+}
+
+/* Report the length and capacity to the caller (if they asked for them). */
+static
+void
+str_cookie_publish(struct str_cookie *self)
+{
+  if (self->length_out != NULL) {
+    *self->length_out = self->length;
+  }
+
+  if (self->capacity_out != NULL) {
+    *self->capacity_out = self->capacity;
+  }
+}
+
+/* Work from the (empty) string kept in the cookie, in place of allocating
+ * one for a stream that may never be written to. *str is left NULL: the
+ * caller only ever sees an allocated string.
+ */
+static
+void
+str_cookie_lazy(struct str_cookie *self)
+{
+  self->empty[0] = '\0';
+  self->buffer = self->empty;
+  self->length = 0;
+  self->capacity = sizeof(self->empty);
+  self->lazy = 1;
+}
+
+/* Move the string kept in the cookie to an allocation of capacity bytes. */
+static
+int
+str_cookie_materialize(struct str_cookie *self, size_t capacity)
+{
+  int status = 0;
+  char *str = NULL;
+
+  str = self->allocator.alloc(self->allocator.context, capacity);
+  if (str == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  memcpy(str, self->buffer, self->length + 1);
+
+  self->buffer = str;
+  *self->str = str;
+  self->capacity = capacity;
+  self->lazy = 0;
+
+cleanup:
+  return status;
+}
+
+/* Ensure the string can hold at least needed bytes (including the trailing
+ * NULL byte). The capacity is grown geometrically so that a sequence of
+ * writes costs amortized constant time per byte.
+ */
+static
+int
+str_cookie_reserve(struct str_cookie *self, size_t needed)
+{
+  int status = 0;
+  char *str = NULL;
+  double scaled = 0;
+  size_t capacity = 0;
+
+  /* Once written to, *str has to stay valid after the stream is gone. */
+  if (self->lazy) {
+    return str_cookie_materialize(self, needed);
+  }
+
+  if (needed <= self->capacity) {
+    goto cleanup;
+  }
+
+  scaled = self->capacity * self->growth;
+  capacity = scaled < (double)SIZE_MAX ? (size_t)scaled : SIZE_MAX;
+  if (capacity < needed) {
+    capacity = needed;
+  }
+
+  str = self->allocator.grow(self->allocator.context, self->buffer, self->capacity, capacity);
+  if (str == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  self->buffer = str;
+  *self->str = str;
+  self->capacity = capacity;
+
+cleanup:
+  return status;
+}
+
+/* Check whether the caller has taken the string (after a flush) and put
+ * something else in *str. It can't be moved or freed after that.
+ */
+static
+int
+str_cookie_taken(struct str_cookie *self)
+{
+  return !self->lazy && *self->str != self->buffer;
+}
+
+/* Shrink the string to exactly length + 1 bytes. Failing to shrink leaves
+ * the (larger) string in place, which is still valid. A string that was
+ * taken is left as it was.
+ */
+static
+void
+str_cookie_fit(struct str_cookie *self)
+{
+  char *str = NULL;
+
+  if (self->capacity == self->length + 1 || str_cookie_taken(self)) {
+    return;
+  }
+
+  str = self->allocator.grow(self->allocator.context, self->buffer, self->capacity, self->length + 1);
+  if (str == NULL) {
+    return;
+  }
+
+  self->buffer = str;
+  *self->str = str;
+  self->capacity = self->length + 1;
+}
+
+/* Leave the string as the caller gets it back when the stream is closed. */
+static
+int
+str_cookie_finish(struct str_cookie *self)
+{
+  int status = 0;
+
+  if (self->lazy) {
+    status = str_cookie_materialize(self, self->length + 1);
+  }
+  else if (self->capacity_out == NULL) {
+    str_cookie_fit(self);
+  }
+
+  str_cookie_publish(self);
+
+  return status;
 }
 
 static
@@ -65,7 +246,7 @@ str_read(void *cookie, char *buf, size_t size)
 {
   struct str_cookie *str_cookie = cookie;
 
-  char *str = *str_cookie->str + str_cookie->offset;
+  char *str = str_cookie->buffer + str_cookie->offset;
   size_t bytes_read = strnlen(str, size);
 
   memcpy(buf, str, bytes_read);
@@ -83,30 +264,28 @@ str_write(void *cookie, const char *buf, size_t size)
 
   size_t bytes_written = size;
   size_t truncate = strnlen(buf, size) < size ? 1 : 0;
-  int append = str_cookie->append;
+  int append = str_cookie->mode.append;
 
-  char *str = *str_cookie->str;
   size_t length = str_cookie->length;
-  size_t offset = (append ? length : str_cookie->offset) + size - truncate;
+  size_t start = append ? length : str_cookie->offset;
+  size_t offset = start + size - truncate;
 
   if (truncate || length < offset) {
     length = offset;
   }
 
-  str = realloc(str, length + 1);
-  if (str == NULL) {
+  status = str_cookie_reserve(str_cookie, length + 1);
+  if (status != 0) {
     status = -1;
     goto cleanup;
   }
 
-  *str_cookie->str = str;
-
-  str += append ? str_cookie->length : str_cookie->offset;
-  memcpy(str, buf, bytes_written);
-  (*str_cookie->str)[length] = '\0';
+  memcpy(str_cookie->buffer + start, buf, bytes_written);
+  str_cookie->buffer[length] = '\0';
 
   str_cookie->length = length;
   str_cookie->offset = append ? str_cookie->offset : offset;
+  str_cookie_publish(str_cookie);
 
 cleanup:
   if (status != 0) {
@@ -150,24 +329,181 @@ cleanup:
   return status;
 }
 
+static
+void
+str_peek(struct ccstreams_stream *stream, const char **data, size_t *avail)
+{
+  struct str_cookie *str_cookie = (struct str_cookie *)stream;
+
+  *data = str_cookie->buffer + str_cookie->offset;
+  *avail = str_cookie->length - str_cookie->offset;
+}
+
+static
+int
+str_writev(struct ccstreams_stream *stream, const struct iovec *iov, int iovcnt, size_t total, off_t *offset)
+{
+  int status = 0;
+  struct str_cookie *str_cookie = (struct str_cookie *)stream;
+
+  size_t start = str_cookie->mode.append ? str_cookie->length : (size_t)str_cookie->offset;
+  size_t needed = str_cookie->length;
+  int i = 0;
+
+  if (!str_cookie->mode.writable) {
+    status = -1;
+    errno = EBADF;
+    goto cleanup;
+  }
+
+  if (total > SIZE_MAX - 1 - start) {
+    status = -1;
+    errno = EOVERFLOW;
+    goto cleanup;
+  }
+
+  if (needed < start + total) {
+    needed = start + total;
+  }
+
+  status = str_cookie_reserve(str_cookie, needed + 1);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  /* With the room there each write is a plain copy. */
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len == 0) continue;
+
+    if (str_write(str_cookie, iov[i].iov_base, iov[i].iov_len) < 0) {
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+  *offset = str_cookie->offset;
+
+cleanup:
+  return status;
+}
+
+static const struct ccstreams_stream_ops str_stream_ops = {
+  .peek = str_peek,
+  .writev = str_writev,
+};
+
 static
 int
 str_close(void *cookie)
 {
   int status = 0;
   struct str_cookie *str_cookie = cookie;
+  struct ccstreams_allocator allocator = str_cookie->allocator;
+
+  ccstreams_stream_unregister(&str_cookie->stream);
+
+  status = str_cookie_finish(str_cookie);
 
   str_cookie_fini(str_cookie);
-  free(str_cookie);
+  allocator.free(allocator.context, str_cookie, sizeof(*str_cookie));
+
+  return status;
+}
+
+/* Get the string at *str ready for a stream opened with mode: allocate it if
+ * it is missing (and the mode allows it) and empty it if the mode truncates.
+ * The length and capacity of an existing string come from *length_in and
+ * *capacity_in when given (see struct ccstreams_str_options). *created is set
+ * if the string was allocated here. On failure nothing allocated here is
+ * kept.
+ *
+ * If lazy, a missing string is left NULL for the stream to start on the
+ * string kept in the cookie (see str_cookie_lazy) and *created is not set.
+ */
+static
+int
+str_buffer_prepare(const struct ccstreams_allocator *allocator, const struct ccstreams_mode *mode,
+                   char **str, const size_t *length_in, const size_t *capacity_in, int lazy,
+                   size_t *length, size_t *capacity, int *created)
+{
+  int status = 0;
+
+  *created = 0;
+  *length = 0;
+  *capacity = 0;
+
+  if (mode->create && *str == NULL && lazy) {
+    *capacity = 1;
+    goto cleanup;
+  }
+
+  if (mode->create && *str == NULL) {
+    *str = allocator->alloc(allocator->context, 1);
+    if (*str == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+
+    *created = 1;
+    *str[0] = '\0';
+    *capacity = 1;
+  }
+
+  if (*str == NULL) {
+    status = -1;
+    errno = ENOENT;
+    goto cleanup;
+  }
+
+  if (!*created) {
+    *length = length_in != NULL ? *length_in : strlen(*str);
+    *capacity = capacity_in != NULL ? *capacity_in : 0;
+    if (*capacity < *length + 1) {
+      *capacity = *length + 1;
+    }
+  }
+
+  if (mode->truncate && !*created) {
+    if (capacity_in == NULL && *capacity != 1) {
+      char *shrunk = allocator->grow(allocator->context, *str, *capacity, 1);
+      if (shrunk == NULL) {
+        status = -1;
+        goto cleanup;
+      }
+
+      *str = shrunk;
+      *capacity = 1;
+    }
+
+    *str[0] = '\0';
+    *length = 0;
+  }
 
+cleanup:
   return status;
 }
 
 FILE *
 ccstreams_fstropen(char **str, const char *mode)
+{
+  return ccstreams_fstropen_options(str, mode, NULL);
+}
+
+FILE *
+ccstreams_fstropen_options(char **str, const char *mode,
+                           const struct ccstreams_str_options *options)
 {
   assert(str != NULL);
 
+  static const struct ccstreams_str_options defaults = {
+    .length = NULL,
+    .capacity = NULL,
+    .growth = CCSTREAMS_STR_GROWTH,
+    .allocator = NULL,
+    .flags = 0,
+  };
+
   int status = 0;
   FILE *stream = NULL;
   struct str_cookie *cookie = NULL;
@@ -177,87 +513,59 @@ ccstreams_fstropen(char **str, const char *mode)
     .seek  = str_seek,
     .close = str_close,
   };
-  size_t mode_length = strlen(mode);
-  int extra = 0;
-  int create = 0;
+  struct ccstreams_mode parsed;
   int created = 0;
-  int append = 0;
-  int truncate = 0;
-  int end = 0;
-  
-  if (mode_length > 1) {
-    if (mode[1] == 'b') {
-      if (mode_length > 2 && mode[2] == '+') {
-        extra = 2;
-      }
-    }
-    else if (mode[1] == '+') {
-      extra = 1;
-    }
+  int lazy = 0;
+  size_t length = 0;
+  size_t capacity = 0;
+  const struct ccstreams_allocator *allocator = NULL;
+
+  if (options == NULL) {
+    options = &defaults;
   }
 
-  switch (mode[0]) {
-    case 'w':
-      if (extra) {
-        create = 1;
-      }
-      truncate = 1;
-      break;
-    case 'a':
-      if (!extra) {
-        end = 1;
-      }
-      create = 1;
-      append = 1;
-      break;
+  allocator = options->allocator;
+  if (allocator == NULL) {
+    allocator = &ccstreams_allocator_default;
   }
 
-  if (create && *str == NULL) {
-    *str = malloc(1);
-    if (*str == NULL) {
-      status = -1;
-      goto cleanup;
-    }
+  ccstreams_mode_parse(&parsed, mode);
 
-    created = 1;
-    *str[0] = '\0';
-  }
+  lazy = parsed.create && *str == NULL && (options->flags & CCSTREAMS_STR_LAZY);
 
-  if (*str == NULL) {
+  status = str_buffer_prepare(allocator, &parsed, str, options->length, options->capacity, lazy, &length, &capacity, &created);
+  if (status != 0) {
     status = -1;
-    errno = ENOENT;
     goto cleanup;
   }
 
-  if (truncate & !created) {
-    *str = realloc(*str, 1);
-    if (*str == NULL) {
-      status = -1;
-      goto cleanup;
-    }
-
-    *str[0] = '\0';
-  }
-
-  cookie = malloc(sizeof(*cookie));
+  cookie = allocator->alloc(allocator->context, sizeof(*cookie));
   if (cookie == NULL) {
     status = -1;
     goto cleanup;
   }
 
-  status = str_cookie_init(cookie, str, append);
+  status = str_cookie_init(cookie, allocator, str, length, capacity, options, &parsed);
   if (status != 0) {
     status = -1;
     goto cleanup;
   }
 
+  if (lazy) {
+    str_cookie_lazy(cookie);
+  }
+
+  str_cookie_publish(cookie);
+
   stream = fopencookie(cookie, mode, str_io_funcs);
   if (stream == NULL) {
     status = -1;
     goto cleanup;
   }
 
-  if (end) {
+  ccstreams_stream_register(&cookie->stream, stream, CCSTREAMS_STREAM_STR, &str_stream_ops);
+
+  if (parsed.end) {
     status = fseek(stream, 0, SEEK_END);
     if (status != 0) {
       status = -1;
@@ -267,14 +575,113 @@ ccstreams_fstropen(char **str, const char *mode)
 
 cleanup:
   if (status != 0) {
-    str_cookie_fini(cookie);
-    free(cookie);
+    if (stream != NULL) {
+      /* Closing the stream releases the cookie. */
+      fclose(stream);
+      stream = NULL;
+      cookie = NULL;
+    }
+
+    if (cookie != NULL) {
+      str_cookie_fini(cookie);
+      allocator->free(allocator->context, cookie, sizeof(*cookie));
+    }
 
-    if (created) {
-      free(*str);
+    /* Closing a lazy stream allocated the string. */
+    if (created || (lazy && *str != NULL)) {
+      allocator->free(allocator->context, *str, 1);
       *str = NULL;
     }
   }
 
   return stream;
 }
+
+int
+ccstreams_str_reset(FILE *stream, char **str)
+{
+  assert(stream != NULL);
+  assert(str != NULL);
+
+  int status = 0;
+  struct str_cookie *str_cookie = NULL;
+  struct ccstreams_stream *found = NULL;
+  size_t length = 0;
+  size_t capacity = 0;
+  int created = 0;
+  int lazy = 0;
+  int taken = 0;
+
+  found = ccstreams_stream_find(stream, CCSTREAMS_STREAM_STR);
+  if (found == NULL) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  str_cookie = (struct str_cookie *)found;
+
+  /* Output pending for the old string lands there. */
+  status = fflush(stream);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  taken = str_cookie_taken(str_cookie);
+
+  /* Leave the old string as closing the stream would (unless it was taken,
+   * in which case it stays as it was after the flush). One that was never
+   * written to hasn't been handed out yet, so given the same variable again
+   * there is nothing to leave.
+   */
+  if (!(str_cookie->lazy && str == str_cookie->str)) {
+    status = str_cookie_finish(str_cookie);
+    if (status != 0) {
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+  lazy = str_cookie->mode.create && *str == NULL && str_cookie->defer;
+
+  status = str_buffer_prepare(&str_cookie->allocator, &str_cookie->mode,
+                              str, str_cookie->length_out, str_cookie->capacity_out, lazy,
+                              &length, &capacity, &created);
+  if (status != 0) {
+    status = -1;
+
+    /* The stream stays on the old string, which is handed back if it was
+     * taken.
+     */
+    if (taken) {
+      *str_cookie->str = str_cookie->buffer;
+    }
+
+    goto cleanup;
+  }
+
+  str_cookie->str = str;
+  str_cookie->buffer = *str;
+  str_cookie->length = length;
+  str_cookie->capacity = capacity;
+  str_cookie->offset = 0;
+
+  if (lazy) {
+    str_cookie_lazy(str_cookie);
+  }
+
+  str_cookie_publish(str_cookie);
+
+  clearerr(stream);
+
+  /* Seeking through stdio resets its idea of the position. */
+  status = fseeko(stream, 0, str_cookie->mode.end ? SEEK_END : SEEK_SET);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+cleanup:
+  return status;
+}
@@ -0,0 +1,112 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "stream.h"
+
+#define STREAM_BUCKETS 64
+
+struct stream_bucket {
+  pthread_mutex_t lock;
+  struct ccstreams_stream *head;
+};
+
+static struct stream_bucket stream_buckets[STREAM_BUCKETS] = {
+  [0 ... STREAM_BUCKETS - 1] = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .head = NULL,
+  },
+};
+
+static
+struct stream_bucket *
+stream_bucket(FILE *file)
+{
+  uint64_t key = (uintptr_t)file;
+
+  key ^= key >> 17;
+  key *= 0x9e3779b97f4a7c15ull;
+
+  return &stream_buckets[(key >> 32) % STREAM_BUCKETS];
+}
+
+void
+ccstreams_stream_register(struct ccstreams_stream *self, FILE *file,
+                          enum ccstreams_stream_type type,
+                          const struct ccstreams_stream_ops *ops)
+{
+  assert(self != NULL);
+  assert(file != NULL);
+
+  struct stream_bucket *bucket = stream_bucket(file);
+
+  self->file = file;
+  self->type = type;
+  self->ops = ops;
+
+  pthread_mutex_lock(&bucket->lock);
+  self->next = bucket->head;
+  bucket->head = self;
+  pthread_mutex_unlock(&bucket->lock);
+}
+
+void
+ccstreams_stream_unregister(struct ccstreams_stream *self)
+{
+  if (self == NULL || self->file == NULL) return;
+
+  struct stream_bucket *bucket = stream_bucket(self->file);
+  struct ccstreams_stream **link = NULL;
+
+  pthread_mutex_lock(&bucket->lock);
+  for (link = &bucket->head; *link != NULL; link = &(*link)->next) {
+    if (*link == self) {
+      *link = self->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&bucket->lock);
+
+  self->file = NULL;
+  self->next = NULL;
+}
+
+struct ccstreams_stream *
+ccstreams_stream_find(FILE *file, enum ccstreams_stream_type type)
+{
+  struct stream_bucket *bucket = stream_bucket(file);
+  struct ccstreams_stream *stream = NULL;
+
+  pthread_mutex_lock(&bucket->lock);
+  for (stream = bucket->head; stream != NULL; stream = stream->next) {
+    if (stream->file == file) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&bucket->lock);
+
+  if (stream != NULL && type != CCSTREAMS_STREAM_ANY && stream->type != type) {
+    stream = NULL;
+  }
+
+  return stream;
+}
@@ -0,0 +1,95 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_SRC_STREAM_H
+#define CCSTREAMS_SRC_STREAM_H 1
+
+#include <stdio.h>
+#include <sys/uio.h>
+
+/* Internal to the library: fopencookie(...) provides no way to get back to
+ * the cookie of a FILE, so the streams register themselves here for the
+ * functions that operate on an open stream.
+ */
+
+enum ccstreams_stream_type {
+  CCSTREAMS_STREAM_ANY,
+  CCSTREAMS_STREAM_MEM,
+  CCSTREAMS_STREAM_STR,
+  CCSTREAMS_STREAM_BUF,
+  CCSTREAMS_STREAM_ROPE,
+  CCSTREAMS_STREAM_MAP,
+  CCSTREAMS_STREAM_SPOOL,
+  CCSTREAMS_STREAM_MEMFD,
+  CCSTREAMS_STREAM_RING,
+  CCSTREAMS_STREAM_FDV,
+};
+
+struct ccstreams_stream;
+
+/* Operations on the backing store of a stream used by the generic functions
+ * (e.g. ccstreams_peek(...)). They are called with stdio flushed, so the
+ * offset of the cookie is the position of the stream. Any may be NULL if the
+ * stream doesn't support it.
+ */
+struct ccstreams_stream_ops {
+  /* Set *data to the data at the current offset and *avail to the number of
+   * bytes available there.
+   */
+  void (*peek)(struct ccstreams_stream *self, const char **data, size_t *avail);
+
+  /* Fill in up to *count segments of the data and set *count to the number
+   * of segments there are.
+   */
+  void (*iov)(struct ccstreams_stream *self, struct iovec *iov, size_t *count);
+
+  /* Make the data a single segment. */
+  int (*flatten)(struct ccstreams_stream *self);
+
+  /* Write the segments (totalling total bytes) at the position of the
+   * stream, growing the storage at most once, and set *offset to the new
+   * position. Called with the stdio buffer flushed.
+   */
+  int (*writev)(struct ccstreams_stream *self, const struct iovec *iov, int iovcnt, size_t total, off_t *offset);
+};
+
+/* Embedded in the cookie of each stream type. */
+struct ccstreams_stream {
+  FILE *file;
+  enum ccstreams_stream_type type;
+  const struct ccstreams_stream_ops *ops;
+  struct ccstreams_stream *next;
+};
+
+/* Associate the stream with file. Called once fopencookie(...) returns. */
+void
+ccstreams_stream_register(struct ccstreams_stream *self, FILE *file,
+                          enum ccstreams_stream_type type,
+                          const struct ccstreams_stream_ops *ops);
+
+/* Remove the association (if any). Called from the close function. */
+void
+ccstreams_stream_unregister(struct ccstreams_stream *self);
+
+/* Find the stream of the given type (or any type for CCSTREAMS_STREAM_ANY)
+ * behind file. Returns NULL if file isn't such a stream.
+ */
+struct ccstreams_stream *
+ccstreams_stream_find(FILE *file, enum ccstreams_stream_type type);
+
+#endif /* CCSTREAMS_SRC_STREAM_H */
@@ -0,0 +1,126 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <ccstreams/tee.h>
+#include <ccstreams/writev.h>
+
+struct tee_cookie {
+  FILE **targets;
+  size_t n;
+};
+
+static
+ssize_t
+tee_write(void *cookie, const char *buf, size_t size)
+{
+  struct tee_cookie *tee_cookie = cookie;
+
+  struct iovec iov = {(char *)buf, size};
+  size_t i = 0;
+  int failed = 0;
+
+  /* Every target gets the write even if an earlier one failed. */
+  for (i = 0; i < tee_cookie->n; i++) {
+    if (ccstreams_writev(tee_cookie->targets[i], &iov, 1) == -1) {
+      failed = errno;
+    }
+  }
+
+  if (failed != 0) {
+    /* A short write (rather than -1) makes stdio flag the error. */
+    errno = failed;
+    return 0;
+  }
+
+  return size;
+}
+
+static
+int
+tee_close(void *cookie)
+{
+  int status = 0;
+  struct tee_cookie *tee_cookie = cookie;
+  size_t i = 0;
+
+  for (i = 0; i < tee_cookie->n; i++) {
+    if (fflush(tee_cookie->targets[i]) != 0) {
+      status = -1;
+    }
+  }
+
+  free(tee_cookie->targets);
+  free(tee_cookie);
+
+  return status;
+}
+
+FILE *
+ccstreams_fteeopen(FILE **targets, size_t n)
+{
+  assert(targets != NULL || n == 0);
+
+  int status = 0;
+  FILE *stream = NULL;
+  struct tee_cookie *cookie = NULL;
+  cookie_io_functions_t tee_io_funcs = {
+    .read  = NULL,
+    .write = tee_write,
+    .seek  = NULL,
+    .close = tee_close,
+  };
+
+  cookie = malloc(sizeof(*cookie));
+  if (cookie == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  cookie->n = n;
+  cookie->targets = malloc((n > 0 ? n : 1) * sizeof(*cookie->targets));
+  if (cookie->targets == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (n > 0) {
+    memcpy(cookie->targets, targets, n * sizeof(*targets));
+  }
+
+  stream = fopencookie(cookie, "w", tee_io_funcs);
+  if (stream == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+cleanup:
+  if (status != 0) {
+    if (cookie != NULL) {
+      free(cookie->targets);
+      free(cookie);
+    }
+  }
+
+  return stream;
+}
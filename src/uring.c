@@ -0,0 +1,430 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+#if defined(HAVE_LINUX_IO_URING_H) && HAVE_DECL_SYS_IO_URING_SETUP && \
+    HAVE_DECL_SYS_IO_URING_ENTER && HAVE_DECL_SYS_IO_URING_REGISTER
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/* Number of chunks in flight and the size of each. */
+#define URING_DEPTH 8
+#define URING_CHUNK (512 * 1024)
+
+#define URING_ALIGN 4096
+
+struct uring_slot {
+  off_t offset;
+  size_t size;
+  size_t done;
+  int writing;
+};
+
+struct uring {
+  int fd;
+  int fixed;
+  unsigned pending;
+
+  void *sq_ring;
+  size_t sq_ring_size;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+
+  void *cq_ring;
+  size_t cq_ring_size;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  char *buffer;
+  struct uring_slot slots[URING_DEPTH];
+};
+
+static
+int
+uring_init(struct uring *self)
+{
+  int status = 0;
+  struct io_uring_params params;
+  struct iovec iov[URING_DEPTH];
+  void *buffer = NULL;
+  size_t i = 0;
+
+  memset(self, 0, sizeof(*self));
+  self->fd = -1;
+  self->sq_ring = MAP_FAILED;
+  self->cq_ring = MAP_FAILED;
+  self->sqes = MAP_FAILED;
+
+  memset(&params, 0, sizeof(params));
+
+  self->fd = syscall(SYS_io_uring_setup, URING_DEPTH, &params);
+  if (self->fd < 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  self->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  self->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (self->cq_ring_size > self->sq_ring_size) {
+      self->sq_ring_size = self->cq_ring_size;
+    }
+    self->cq_ring_size = self->sq_ring_size;
+  }
+
+  self->sq_ring = mmap(NULL, self->sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQ_RING);
+  if (self->sq_ring == MAP_FAILED) {
+    status = -1;
+    goto cleanup;
+  }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    self->cq_ring = self->sq_ring;
+  }
+  else {
+    self->cq_ring = mmap(NULL, self->cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_CQ_RING);
+    if (self->cq_ring == MAP_FAILED) {
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+  self->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  self->sqes = mmap(NULL, self->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQES);
+  if (self->sqes == MAP_FAILED) {
+    status = -1;
+    goto cleanup;
+  }
+
+  self->sq_head = (unsigned *)((char *)self->sq_ring + params.sq_off.head);
+  self->sq_tail = (unsigned *)((char *)self->sq_ring + params.sq_off.tail);
+  self->sq_mask = (unsigned *)((char *)self->sq_ring + params.sq_off.ring_mask);
+  self->sq_array = (unsigned *)((char *)self->sq_ring + params.sq_off.array);
+
+  self->cq_head = (unsigned *)((char *)self->cq_ring + params.cq_off.head);
+  self->cq_tail = (unsigned *)((char *)self->cq_ring + params.cq_off.tail);
+  self->cq_mask = (unsigned *)((char *)self->cq_ring + params.cq_off.ring_mask);
+  self->cqes = (struct io_uring_cqe *)((char *)self->cq_ring + params.cq_off.cqes);
+
+  status = posix_memalign(&buffer, URING_ALIGN, URING_DEPTH * URING_CHUNK);
+  if (status != 0) {
+    errno = status;
+    status = -1;
+    goto cleanup;
+  }
+  self->buffer = buffer;
+
+  /* Registered buffers save pinning the pages on every request. They count
+   * against RLIMIT_MEMLOCK, so carry on with plain requests if refused.
+   */
+  for (i = 0; i < URING_DEPTH; i++) {
+    iov[i].iov_base = self->buffer + i * URING_CHUNK;
+    iov[i].iov_len = URING_CHUNK;
+  }
+
+  self->fixed = syscall(SYS_io_uring_register, self->fd,
+                        IORING_REGISTER_BUFFERS, iov, URING_DEPTH) == 0;
+
+cleanup:
+  return status;
+}
+
+static
+void
+uring_fini(struct uring *self)
+{
+  if (self->sqes != MAP_FAILED) {
+    munmap(self->sqes, self->sqes_size);
+  }
+
+  if (self->cq_ring != MAP_FAILED && self->cq_ring != self->sq_ring) {
+    munmap(self->cq_ring, self->cq_ring_size);
+  }
+
+  if (self->sq_ring != MAP_FAILED) {
+    munmap(self->sq_ring, self->sq_ring_size);
+  }
+
+  /* Closing the ring unregisters the buffers. */
+  if (self->fd >= 0) {
+    close(self->fd);
+  }
+
+  free(self->buffer);
+}
+
+/* Queue a read or write of slot. The ring has an entry for each slot, so
+ * there is always room.
+ */
+static
+void
+uring_queue(struct uring *self, size_t index, int fd, off_t offset)
+{
+  struct uring_slot *slot = &self->slots[index];
+  unsigned tail = *self->sq_tail;
+  unsigned entry = tail & *self->sq_mask;
+  struct io_uring_sqe *sqe = &self->sqes[entry];
+  char *data = self->buffer + index * URING_CHUNK;
+
+  memset(sqe, 0, sizeof(*sqe));
+
+  if (slot->writing) {
+    sqe->opcode = self->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->addr = (unsigned long)(data + slot->done);
+    sqe->len = slot->size - slot->done;
+    sqe->off = offset + slot->done;
+  }
+  else {
+    sqe->opcode = self->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->addr = (unsigned long)data;
+    sqe->len = slot->size;
+    sqe->off = offset;
+  }
+
+  sqe->fd = fd;
+  sqe->buf_index = self->fixed ? index : 0;
+  sqe->user_data = index;
+
+  self->sq_array[entry] = entry;
+  __atomic_store_n(self->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  self->pending++;
+}
+
+/* Submit what was queued and wait for at least one completion. */
+static
+int
+uring_enter(struct uring *self)
+{
+  int status = 0;
+
+  do {
+    status = syscall(SYS_io_uring_enter, self->fd, self->pending, 1,
+                     IORING_ENTER_GETEVENTS, NULL, 0);
+  } while (status < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+
+  if (status < 0) {
+    return -1;
+  }
+
+  self->pending -= status;
+
+  return 0;
+}
+
+ssize_t
+ccstreams_uring_copy(int in, int out, size_t count)
+{
+  ssize_t status = 0;
+  struct uring uring;
+  struct stat in_stat;
+  off_t in_base = 0;
+  off_t out_base = 0;
+  off_t next = 0;
+  off_t end = 0;
+  off_t failed = 0;
+  size_t inflight = 0;
+  size_t i = 0;
+  int error = 0;
+
+  in_base = lseek(in, 0, SEEK_CUR);
+  out_base = lseek(out, 0, SEEK_CUR);
+  if (in_base < 0 || out_base < 0 || fstat(in, &in_stat) != 0) {
+    return -1;
+  }
+
+  if (in_stat.st_size <= in_base) {
+    return 0;
+  }
+
+  end = in_stat.st_size - in_base;
+  if ((size_t)end > count) {
+    end = count;
+  }
+
+  failed = end;
+
+  if (uring_init(&uring) != 0) {
+    /* Whatever stopped the ring being set up (not built in, disabled by
+     * seccomp or sysctl, or short of memory, locked memory or descriptors),
+     * the copy itself hasn't started and the other methods can still do it.
+     */
+    errno = ENOSYS;
+    status = -1;
+    goto cleanup;
+  }
+
+  for (i = 0; i < URING_DEPTH && next < end; i++) {
+    struct uring_slot *slot = &uring.slots[i];
+
+    slot->offset = next;
+    slot->size = end - next < URING_CHUNK ? end - next : URING_CHUNK;
+    slot->done = 0;
+    slot->writing = 0;
+    next += slot->size;
+
+    uring_queue(&uring, i, in, in_base + slot->offset);
+    inflight++;
+  }
+
+  while (inflight > 0) {
+    unsigned head = 0;
+    unsigned tail = 0;
+
+    if (uring_enter(&uring) != 0) {
+      /* Requests may still be in flight and using the buffers, so they can't
+       * be freed. Give them up rather than risk that.
+       */
+      uring.buffer = NULL;
+      status = -1;
+      goto cleanup;
+    }
+
+    head = *uring.cq_head;
+    tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+      struct io_uring_cqe *cqe = &uring.cqes[head & *uring.cq_mask];
+      size_t index = cqe->user_data;
+      struct uring_slot *slot = &uring.slots[index];
+      int res = cqe->res;
+
+      if (res == -EINTR || res == -EAGAIN) {
+        uring_queue(&uring, index, slot->writing ? out : in,
+                    (slot->writing ? out_base : in_base) + slot->offset);
+        continue;
+      }
+
+      if (res < 0) {
+        if (error == 0) {
+          error = -res;
+        }
+        if (slot->offset < failed) {
+          failed = slot->offset;
+        }
+        inflight--;
+        continue;
+      }
+
+      if (!slot->writing) {
+        if (res == 0) {
+          /* The file shrank under us. */
+          if (slot->offset < end) {
+            end = slot->offset;
+          }
+          inflight--;
+          continue;
+        }
+
+        if ((size_t)res < slot->size && slot->offset + res < end) {
+          end = slot->offset + res;
+        }
+
+        slot->size = res;
+        slot->done = 0;
+        slot->writing = 1;
+        uring_queue(&uring, index, out, out_base + slot->offset);
+        continue;
+      }
+
+      slot->done += res;
+      if (res > 0 && slot->done < slot->size && error == 0) {
+        uring_queue(&uring, index, out, out_base + slot->offset);
+        continue;
+      }
+
+      if (slot->done < slot->size) {
+        if (error == 0) {
+          error = EIO;
+        }
+        if (slot->offset < failed) {
+          failed = slot->offset;
+        }
+      }
+
+      if (next < end && error == 0) {
+        slot->offset = next;
+        slot->size = end - next < URING_CHUNK ? end - next : URING_CHUNK;
+        slot->done = 0;
+        slot->writing = 0;
+        next += slot->size;
+
+        uring_queue(&uring, index, in, in_base + slot->offset);
+        continue;
+      }
+
+      inflight--;
+    }
+
+    __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  /* Chunks complete out of order. Everything before the first chunk that
+   * failed (or the end, if the file shrank) was copied.
+   */
+  status = failed < end ? failed : end;
+
+  lseek(in, in_base + status, SEEK_SET);
+  lseek(out, out_base + status, SEEK_SET);
+
+  if (status == 0 && error != 0) {
+    errno = error;
+    status = -1;
+  }
+
+cleanup:
+  uring_fini(&uring);
+
+  return status;
+}
+
+#else
+
+ssize_t
+ccstreams_uring_copy(int in, int out, size_t count)
+{
+  (void)in;
+  (void)out;
+  (void)count;
+
+  errno = ENOSYS;
+  return -1;
+}
+
+#endif
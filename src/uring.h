@@ -0,0 +1,36 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCSTREAMS_SRC_URING_H
+#define CCSTREAMS_SRC_URING_H 1
+
+#include <sys/types.h>
+
+/* Internal to the library: copy between regular files through io_uring,
+ * keeping several reads and writes in flight.
+ *
+ * Copies up to count bytes from the offset of in to the offset of out and
+ * moves both offsets past what was copied. Like write(2), returns the number
+ * of bytes copied (0 at the end of in) even if an error stopped the copy
+ * early (the next call reports it). Returns -1 on error, with errno ENOSYS if
+ * io_uring isn't available or the ring couldn't be set up.
+ */
+ssize_t
+ccstreams_uring_copy(int in, int out, size_t count);
+
+#endif /* CCSTREAMS_SRC_URING_H */
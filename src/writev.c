@@ -0,0 +1,99 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccstreams/writev.h>
+
+#include "stream.h"
+
+ssize_t
+ccstreams_writev(FILE *stream, const struct iovec *iov, int iovcnt)
+{
+  assert(stream != NULL);
+  assert(iov != NULL || iovcnt == 0);
+
+  int status = 0;
+  struct ccstreams_stream *found = NULL;
+  size_t total = 0;
+  off_t offset = 0;
+  int i = 0;
+
+  if (iovcnt < 0) {
+    status = -1;
+    errno = EINVAL;
+    goto cleanup;
+  }
+
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len > SSIZE_MAX - total) {
+      status = -1;
+      errno = EINVAL;
+      goto cleanup;
+    }
+
+    total += iov[i].iov_len;
+  }
+
+  found = ccstreams_stream_find(stream, CCSTREAMS_STREAM_ANY);
+
+  if (found == NULL || found->ops->writev == NULL) {
+    for (i = 0; i < iovcnt; i++) {
+      if (fwrite(iov[i].iov_base, 1, iov[i].iov_len, stream) != iov[i].iov_len) {
+        status = -1;
+        goto cleanup;
+      }
+    }
+
+    goto cleanup;
+  }
+
+  /* Earlier output has to land first and the offset has to reflect the
+   * position of the stream.
+   */
+  status = fflush(stream);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  status = found->ops->writev(found, iov, iovcnt, total, &offset);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+  /* Seeking through stdio keeps its idea of the position in sync. */
+  status = fseeko(stream, offset, SEEK_SET);
+  if (status != 0) {
+    status = -1;
+    goto cleanup;
+  }
+
+cleanup:
+  if (status != 0) {
+    return status;
+  }
+
+  return total;
+}
@@ -0,0 +1,203 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compare the copy strategies on a stream that has no descriptor (so every
+ * byte goes through the userspace loop) and on a pair of files.
+ *
+ * Usage: copy [megabytes]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ccstreams/copy.h>
+
+struct source {
+  size_t remaining;
+};
+
+static
+ssize_t
+source_read(void *c, char *buf, size_t size)
+{
+  struct source *self = c;
+
+  if (size > self->remaining) {
+    size = self->remaining;
+  }
+
+  memset(buf, 'x', size);
+  self->remaining -= size;
+
+  return size;
+}
+
+static
+int
+source_close(void *c)
+{
+  free(c);
+
+  return 0;
+}
+
+static
+FILE *
+source_open(size_t size)
+{
+  struct source *self = malloc(sizeof(*self));
+  cookie_io_functions_t io = {
+    .read = source_read,
+    .close = source_close,
+  };
+  FILE *stream = NULL;
+
+  if (self == NULL) {
+    return NULL;
+  }
+
+  self->remaining = size;
+
+  stream = fopencookie(self, "r", io);
+  if (stream == NULL) {
+    free(self);
+  }
+
+  return stream;
+}
+
+/* The loop ccstreams_copy used to run: a 4KiB buffer on the stack. */
+static
+int
+legacy_copy(FILE *from, FILE *to, size_t *bytes)
+{
+  char buffer[4096];
+  size_t bytes_read = 0;
+
+  do {
+    bytes_read = fread(buffer, 1, sizeof(buffer), from);
+    *bytes += fwrite(buffer, 1, bytes_read, to);
+    if (ferror(from) || ferror(to)) {
+      return -1;
+    }
+  } while (!feof(from));
+
+  return 0;
+}
+
+static
+int
+by_4k(FILE *from, FILE *to, size_t *bytes)
+{
+  return ccstreams_copy_by(from, to, bytes, 4096);
+}
+
+struct strategy {
+  const char *name;
+  int (*copy)(FILE *from, FILE *to, size_t *bytes);
+};
+
+static const struct strategy strategies[] = {
+  { "legacy 4KiB", legacy_copy },
+  { "copy_by 4KiB", by_4k },
+  { "copy (adaptive)", ccstreams_copy },
+};
+
+static
+double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static
+void
+report(const char *what, const struct strategy *strategy, size_t bytes, double elapsed)
+{
+  printf("%-8s %-16s %10.1f MB/s\n", what, strategy->name, bytes / elapsed / 1e6);
+}
+
+int
+main(int argc, char *argv[])
+{
+  size_t size = (argc > 1 ? strtoul(argv[1], NULL, 10) : 256) * 1024 * 1024;
+  size_t i = 0;
+
+  for (i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++) {
+    FILE *from = source_open(size);
+    FILE *to = fopen("/dev/null", "w");
+    size_t bytes = 0;
+    double started = 0;
+
+    if (from == NULL || to == NULL) {
+      perror("open");
+      return EXIT_FAILURE;
+    }
+
+    started = now();
+    if (strategies[i].copy(from, to, &bytes) != 0 || bytes != size) {
+      perror("copy");
+      return EXIT_FAILURE;
+    }
+    report("cookie", &strategies[i], bytes, now() - started);
+
+    fclose(from);
+    fclose(to);
+  }
+
+  for (i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++) {
+    FILE *from = tmpfile();
+    FILE *to = tmpfile();
+    FILE *source = source_open(size);
+    size_t bytes = 0;
+    double started = 0;
+
+    if (from == NULL || to == NULL || source == NULL) {
+      perror("open");
+      return EXIT_FAILURE;
+    }
+
+    if (ccstreams_copy(source, from, &bytes) != 0 || fflush(from) != 0) {
+      perror("fill");
+      return EXIT_FAILURE;
+    }
+    rewind(from);
+    bytes = 0;
+
+    started = now();
+    if (strategies[i].copy(from, to, &bytes) != 0 || bytes != size) {
+      perror("copy");
+      return EXIT_FAILURE;
+    }
+    fflush(to);
+    report("file", &strategies[i], bytes, now() - started);
+
+    fclose(source);
+    fclose(from);
+    fclose(to);
+  }
+
+  return EXIT_SUCCESS;
+}
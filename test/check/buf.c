@@ -0,0 +1,257 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccstreams/buf.h>
+#include <ccstreams/peek.h>
+
+#define BUF_INITIAL "Hello World!"
+
+START_TEST(buf_rw_read)
+{
+  char storage[64] = BUF_INITIAL;
+  char *buf = storage;
+  size_t length = sizeof(BUF_INITIAL) - 1;
+  char line[64];
+  FILE *stream = NULL;
+
+  stream = ccstreams_fbufopen(&buf, sizeof(storage), &length, "r", CCSTREAMS_BUF_FAIL);
+  fail_unless(stream != NULL, strerror(errno));
+
+  fail_unless(fgets(line, sizeof(line), stream) != NULL, strerror(errno));
+  fail_unless(strcmp(line, BUF_INITIAL) == 0, line);
+  fail_unless(fgetc(stream) == EOF && feof(stream));
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(buf_rw_write)
+{
+  char storage[64];
+  char *buf = storage;
+  size_t length = 0;
+  const char *data = NULL;
+  size_t avail = 0;
+  FILE *stream = NULL;
+
+  stream = ccstreams_fbufopen(&buf, sizeof(storage), &length, "w+", CCSTREAMS_BUF_FAIL);
+  fail_unless(stream != NULL, strerror(errno));
+
+  /* No flush needed. */
+  fail_unless(fprintf(stream, "%s %d", "Hello", 42) == 8, strerror(errno));
+  fail_unless(length == 8);
+  fail_unless(strncmp(storage, "Hello 42", length) == 0);
+
+  fail_unless(fseek(stream, 6, SEEK_SET) == 0, strerror(errno));
+  fail_unless(ccstreams_peek(stream, &data, &avail) == 0, strerror(errno));
+  fail_unless(data == storage + 6 && avail == 2);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+  fail_unless(buf == storage);
+}
+END_TEST
+
+START_TEST(buf_rw_append)
+{
+  char storage[64] = BUF_INITIAL;
+  char *buf = storage;
+  size_t length = sizeof(BUF_INITIAL) - 1;
+  FILE *stream = NULL;
+
+  stream = ccstreams_fbufopen(&buf, sizeof(storage), &length, "a", CCSTREAMS_BUF_FAIL);
+  fail_unless(stream != NULL, strerror(errno));
+  fail_unless(ftell(stream) == (long)length);
+
+  fail_unless(fputs(" Bye!", stream) >= 0, strerror(errno));
+  fail_unless(length == sizeof(BUF_INITIAL " Bye!") - 1);
+  fail_unless(strncmp(storage, BUF_INITIAL " Bye!", length) == 0);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(buf_overflow_truncate)
+{
+  char storage[8];
+  char *buf = storage;
+  size_t length = 0;
+  FILE *stream = NULL;
+
+  stream = ccstreams_fbufopen(&buf, sizeof(storage), &length, "w", CCSTREAMS_BUF_TRUNCATE);
+  fail_unless(stream != NULL, strerror(errno));
+
+  fail_unless(fputs(BUF_INITIAL, stream) >= 0, strerror(errno));
+  fail_unless(fputs(BUF_INITIAL, stream) >= 0, strerror(errno));
+  fail_unless(ferror(stream) == 0);
+  fail_unless(length == sizeof(storage));
+  fail_unless(strncmp(storage, BUF_INITIAL, sizeof(storage)) == 0);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+  fail_unless(buf == storage);
+}
+END_TEST
+
+START_TEST(buf_overflow_fail)
+{
+  char storage[8];
+  char *buf = storage;
+  size_t length = 0;
+  FILE *stream = NULL;
+
+  stream = ccstreams_fbufopen(&buf, sizeof(storage), &length, "w", CCSTREAMS_BUF_FAIL);
+  fail_unless(stream != NULL, strerror(errno));
+
+  fail_unless(fputs("Hello", stream) >= 0, strerror(errno));
+  fail_unless(fputs(" World!", stream) == EOF);
+  fail_unless(errno == ENOSPC, strerror(errno));
+  fail_unless(ferror(stream));
+  fail_unless(length >= 5 && length < 5 + 7, "length: %zu", length);
+  fail_unless(strncmp(storage, "Hello World!", length) == 0);
+
+  fclose(stream);
+  fail_unless(buf == storage);
+}
+END_TEST
+
+START_TEST(buf_overflow_spill)
+{
+  char storage[8];
+  char *buf = storage;
+  size_t length = 0;
+  FILE *stream = NULL;
+  size_t i = 0;
+
+  stream = ccstreams_fbufopen(&buf, sizeof(storage), &length, "w", CCSTREAMS_BUF_SPILL);
+  fail_unless(stream != NULL, strerror(errno));
+
+  fail_unless(fputs("Hello", stream) >= 0, strerror(errno));
+  fail_unless(buf == storage);
+
+  for (i = 0; i < 1000; i++) {
+    fail_unless(fprintf(stream, "%04zu", i) == 4, strerror(errno));
+  }
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+  fail_unless(buf != storage);
+  fail_unless(length == 5 + 4000);
+  fail_unless(strncmp(buf, "Hello0000", 9) == 0);
+  fail_unless(strncmp(buf + length - 4, "0999", 4) == 0);
+
+  free(buf);
+}
+END_TEST
+
+START_TEST(buf_invalid)
+{
+  char storage[8];
+  char *buf = storage;
+  size_t length = sizeof(storage) + 1;
+
+  fail_unless(ccstreams_fbufopen(&buf, sizeof(storage), &length, "r", CCSTREAMS_BUF_FAIL) == NULL);
+  fail_unless(errno == EINVAL);
+}
+END_TEST
+
+START_TEST(buf_reset)
+{
+  char first[8];
+  char second[64] = BUF_INITIAL;
+  char *buf = first;
+  size_t length = 0;
+  size_t second_length = sizeof(BUF_INITIAL) - 1;
+  char line[64];
+  FILE *stream = NULL;
+
+  stream = ccstreams_fbufopen(&buf, sizeof(first), &length, "a+", CCSTREAMS_BUF_SPILL);
+  fail_unless(stream != NULL, strerror(errno));
+
+  /* The first buffer spills and is the caller's after the reset. */
+  fail_unless(fputs("Hello World!", stream) >= 0, strerror(errno));
+  fail_unless(fseek(stream, 0, SEEK_END) == 0, strerror(errno));
+  fail_unless(fgetc(stream) == EOF && feof(stream));
+  fail_unless(buf != first && length == 12);
+  fail_unless(strncmp(buf, "Hello World!", length) == 0);
+  free(buf);
+
+  buf = second;
+  fail_unless(ccstreams_buf_reset(stream, &buf, sizeof(second), &second_length) == 0, strerror(errno));
+  fail_unless(feof(stream) == 0);
+
+  /* "a+" keeps the data, reads from the start and appends. */
+  fail_unless(fgets(line, sizeof(line), stream) != NULL, strerror(errno));
+  fail_unless(strcmp(line, BUF_INITIAL) == 0, line);
+  fail_unless(fputs("!!", stream) >= 0, strerror(errno));
+  fail_unless(buf == second && second_length == sizeof(BUF_INITIAL) + 1);
+  fail_unless(strncmp(second, BUF_INITIAL "!!", second_length) == 0);
+
+  second_length = sizeof(second) + 1;
+  fail_unless(ccstreams_buf_reset(stream, &buf, sizeof(second), &second_length) == -1);
+  fail_unless(errno == EINVAL);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+
+  fail_unless(ccstreams_buf_reset(stdin, &buf, sizeof(second), &length) == -1);
+  fail_unless(errno == EINVAL);
+}
+END_TEST
+
+Suite *
+buf_suite(void)
+{
+  Suite *suite = suite_create("buf");
+
+  TCase *tc_buf_rw = tcase_create("buf rw");
+
+  tcase_add_test(tc_buf_rw, buf_rw_read);
+  tcase_add_test(tc_buf_rw, buf_rw_write);
+  tcase_add_test(tc_buf_rw, buf_rw_append);
+  tcase_add_test(tc_buf_rw, buf_invalid);
+  tcase_add_test(tc_buf_rw, buf_reset);
+
+  suite_add_tcase(suite, tc_buf_rw);
+
+  TCase *tc_buf_overflow = tcase_create("buf overflow");
+
+  tcase_add_test(tc_buf_overflow, buf_overflow_truncate);
+  tcase_add_test(tc_buf_overflow, buf_overflow_fail);
+  tcase_add_test(tc_buf_overflow, buf_overflow_spill);
+
+  suite_add_tcase(suite, tc_buf_overflow);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *sr = srunner_create(buf_suite());
+
+  srunner_run_all(sr, CK_NORMAL);
+  failed = srunner_ntests_failed(sr);
+
+  srunner_free(sr);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
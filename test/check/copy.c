@@ -0,0 +1,510 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <ccstreams/copy.h>
+#include <ccstreams/mem.h>
+#include <ccstreams/str.h>
+
+#include "uring.h"
+
+FILE *from = NULL;
+FILE *to = NULL;
+
+#define COPY_LINES 100000
+#define COPY_LINE "%08zu\n"
+#define COPY_LINE_SIZE 9
+
+void
+copy_setup(void)
+{
+  size_t i = 0;
+
+  from = tmpfile();
+  fail_unless(from != NULL, strerror(errno));
+
+  for (i = 0; i < COPY_LINES; i++) {
+    fail_unless(fprintf(from, COPY_LINE, i) == COPY_LINE_SIZE, strerror(errno));
+  }
+
+  rewind(from);
+
+  to = tmpfile();
+  fail_unless(to != NULL, strerror(errno));
+}
+
+void
+copy_teardown(void)
+{
+  if (from != NULL) {
+    fclose(from);
+    from = NULL;
+  }
+
+  if (to != NULL) {
+    fclose(to);
+    to = NULL;
+  }
+}
+
+/* Check that stream holds the lines from first on, starting at offset. */
+static
+void
+copy_verify(FILE *stream, long offset, size_t first)
+{
+  char line[64];
+  char expected[64];
+  size_t i = 0;
+
+  fail_unless(fseek(stream, offset, SEEK_SET) == 0, strerror(errno));
+
+  for (i = first; i < COPY_LINES; i++) {
+    snprintf(expected, sizeof(expected), COPY_LINE, i);
+    fail_unless(fgets(line, sizeof(line), stream) != NULL, strerror(errno));
+    fail_unless(strcmp(line, expected) == 0, "line: '%s' expected: '%s'", line, expected);
+  }
+
+  fail_unless(fgetc(stream) == EOF);
+}
+
+START_TEST(copy_file_to_file)
+{
+  int status = 0;
+  size_t bytes = 0;
+  char line[64];
+
+  /* Leave stdio holding read ahead data. */
+  fail_unless(fgets(line, sizeof(line), from) != NULL, strerror(errno));
+
+  /* And holding output. */
+  fail_unless(fputs("header\n", to) >= 0, strerror(errno));
+
+  status = ccstreams_copy(from, to, &bytes);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(bytes == (COPY_LINES - 1) * COPY_LINE_SIZE, "bytes: %zu", bytes);
+  fail_unless(feof(from));
+  fail_unless(ftell(to) == (long)(bytes + 7), "ftell: %ld", ftell(to));
+
+  rewind(to);
+  fail_unless(fgets(line, sizeof(line), to) != NULL, strerror(errno));
+  fail_unless(strcmp(line, "header\n") == 0);
+
+  copy_verify(to, 7, 1);
+}
+END_TEST
+
+START_TEST(copy_pipe_to_file)
+{
+  int status = 0;
+  size_t bytes = 0;
+  int fds[2];
+  pid_t pid = 0;
+  FILE *pipe_from = NULL;
+  char line[64];
+
+  fail_unless(pipe(fds) == 0, strerror(errno));
+
+  pid = fork();
+  fail_unless(pid >= 0, strerror(errno));
+
+  if (pid == 0) {
+    FILE *pipe_to = fdopen(fds[1], "w");
+    close(fds[0]);
+    status = ccstreams_copy(from, pipe_to, &bytes);
+    fclose(pipe_to);
+    _exit(status == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  close(fds[1]);
+  pipe_from = fdopen(fds[0], "r");
+  fail_unless(pipe_from != NULL, strerror(errno));
+
+  /* Leave stdio holding read ahead data that can't be given back. */
+  fail_unless(fgets(line, sizeof(line), pipe_from) != NULL, strerror(errno));
+
+  status = ccstreams_copy(pipe_from, to, &bytes);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(bytes == (COPY_LINES - 1) * COPY_LINE_SIZE, "bytes: %zu", bytes);
+  fail_unless(feof(pipe_from));
+
+  fclose(pipe_from);
+  fail_unless(waitpid(pid, &status, 0) == pid);
+  fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+  copy_verify(to, 0, 1);
+}
+END_TEST
+
+START_TEST(copy_file_to_mem)
+{
+  int status = 0;
+  size_t bytes = 0;
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+
+  buf_stream = ccstreams_fmemopen(&buf, &buf_size, "w+");
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  status = ccstreams_copy_by(from, buf_stream, &bytes, 1000);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(bytes == COPY_LINES * COPY_LINE_SIZE, "bytes: %zu", bytes);
+  fail_unless(fflush(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == COPY_LINES * COPY_LINE_SIZE, "size: %zu", buf_size);
+
+  copy_verify(buf_stream, 0, 0);
+
+  fclose(buf_stream);
+  free(buf);
+}
+END_TEST
+
+START_TEST(copy_mem_to_file)
+{
+  int status = 0;
+  size_t bytes = 0;
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+
+  buf_stream = ccstreams_fmemopen(&buf, &buf_size, "w+");
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  status = ccstreams_copy(from, buf_stream, &bytes);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(bytes == COPY_LINES * COPY_LINE_SIZE, "bytes: %zu", bytes);
+
+  /* Skip a line through stdio first. */
+  rewind(buf_stream);
+  fail_unless(fseek(buf_stream, COPY_LINE_SIZE, SEEK_SET) == 0, strerror(errno));
+
+  bytes = 0;
+  status = ccstreams_copy(buf_stream, to, &bytes);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(bytes == (COPY_LINES - 1) * COPY_LINE_SIZE, "bytes: %zu", bytes);
+  fail_unless(feof(buf_stream));
+  fail_unless(ftell(to) == (long)bytes, "ftell: %ld", ftell(to));
+
+  copy_verify(to, 0, 1);
+
+  fclose(buf_stream);
+  free(buf);
+}
+END_TEST
+
+START_TEST(copy_pipe_to_mem)
+{
+  int status = 0;
+  size_t bytes = 0;
+  int fds[2];
+  pid_t pid = 0;
+  FILE *pipe_from = NULL;
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+
+  fail_unless(pipe(fds) == 0, strerror(errno));
+
+  pid = fork();
+  fail_unless(pid >= 0, strerror(errno));
+
+  if (pid == 0) {
+    FILE *pipe_to = fdopen(fds[1], "w");
+    close(fds[0]);
+    status = ccstreams_copy(from, pipe_to, &bytes);
+    fclose(pipe_to);
+    _exit(status == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  close(fds[1]);
+  pipe_from = fdopen(fds[0], "r");
+  fail_unless(pipe_from != NULL, strerror(errno));
+
+  buf_stream = ccstreams_fmemopen(&buf, &buf_size, "a+");
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  status = ccstreams_copy(pipe_from, buf_stream, &bytes);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(bytes == COPY_LINES * COPY_LINE_SIZE, "bytes: %zu", bytes);
+  fail_unless(buf_size == COPY_LINES * COPY_LINE_SIZE, "size: %zu", buf_size);
+
+  fclose(pipe_from);
+  fail_unless(waitpid(pid, &status, 0) == pid);
+  fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+  copy_verify(buf_stream, 0, 0);
+
+  fclose(buf_stream);
+  free(buf);
+}
+END_TEST
+
+START_TEST(copy_str_to_str)
+{
+  int status = 0;
+  size_t bytes = 0;
+  char *src = NULL;
+  char *dst = NULL;
+  FILE *src_stream = NULL;
+  FILE *dst_stream = NULL;
+
+  src_stream = ccstreams_fstropen(&src, "w+");
+  fail_unless(src_stream != NULL, strerror(errno));
+  fail_unless(fputs("Hello World!", src_stream) >= 0, strerror(errno));
+  rewind(src_stream);
+
+  dst_stream = ccstreams_fstropen(&dst, "a");
+  fail_unless(dst_stream != NULL, strerror(errno));
+
+  status = ccstreams_copy(src_stream, dst_stream, &bytes);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(bytes == 12, "bytes: %zu", bytes);
+
+  fclose(src_stream);
+  fclose(dst_stream);
+
+  fail_unless(strcmp(dst, "Hello World!") == 0, dst);
+
+  free(src);
+  free(dst);
+}
+END_TEST
+
+START_TEST(copy_with_buffer)
+{
+  int status = 0;
+  size_t bytes = 0;
+  char buffer[4096];
+  char *dst = NULL;
+  FILE *dst_stream = NULL;
+
+  dst_stream = ccstreams_fstropen(&dst, "w+");
+  fail_unless(dst_stream != NULL, strerror(errno));
+
+  /* The same buffer serves both copies. */
+  status = ccstreams_copy_with(from, dst_stream, &bytes, buffer, sizeof(buffer));
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(bytes == COPY_LINES * COPY_LINE_SIZE, "bytes: %zu", bytes);
+
+  rewind(dst_stream);
+  bytes = 0;
+
+  status = ccstreams_copy_with(dst_stream, to, &bytes, buffer, sizeof(buffer));
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(bytes == COPY_LINES * COPY_LINE_SIZE, "bytes: %zu", bytes);
+
+  copy_verify(to, 0, 0);
+
+  fclose(dst_stream);
+  free(dst);
+}
+END_TEST
+
+START_TEST(copy_async_pipe_to_file)
+{
+  int status = 0;
+  size_t bytes = 0;
+  int fds[2];
+  pid_t pid = 0;
+  FILE *pipe_from = NULL;
+
+  fail_unless(pipe(fds) == 0, strerror(errno));
+
+  pid = fork();
+  fail_unless(pid >= 0, strerror(errno));
+
+  if (pid == 0) {
+    FILE *pipe_to = fdopen(fds[1], "w");
+    close(fds[0]);
+    status = ccstreams_copy_async(from, pipe_to, &bytes, 1000);
+    fclose(pipe_to);
+    _exit(status == 0 && bytes == COPY_LINES * COPY_LINE_SIZE ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  close(fds[1]);
+  pipe_from = fdopen(fds[0], "r");
+  fail_unless(pipe_from != NULL, strerror(errno));
+
+  status = ccstreams_copy_async(pipe_from, to, &bytes, 4096);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(bytes == COPY_LINES * COPY_LINE_SIZE, "bytes: %zu", bytes);
+  fail_unless(feof(pipe_from));
+
+  fclose(pipe_from);
+  fail_unless(waitpid(pid, &status, 0) == pid);
+  fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+  copy_verify(to, 0, 0);
+}
+END_TEST
+
+START_TEST(copy_async_write_error)
+{
+  int status = 0;
+  size_t bytes = 0;
+  FILE *full = fopen("/dev/full", "w");
+
+  if (full == NULL) {
+    return;
+  }
+
+  status = ccstreams_copy_async(from, full, &bytes, 4096);
+  fail_unless(status == -1);
+  fail_unless(errno == ENOSPC, strerror(errno));
+
+  fclose(full);
+}
+END_TEST
+
+/* ccstreams_copy(...) only gets to io_uring when copy_file_range(...) can't
+ * do the copy (e.g. across file systems), so exercise it directly.
+ */
+START_TEST(copy_uring)
+{
+  ssize_t copied = 0;
+  size_t bytes = 0;
+  int in = fileno(from);
+  int out = fileno(to);
+
+  /* Start part way in to check that the offsets are used and moved. */
+  fail_unless(lseek(in, COPY_LINE_SIZE, SEEK_SET) == COPY_LINE_SIZE, strerror(errno));
+
+  do {
+    copied = ccstreams_uring_copy(in, out, SIZE_MAX);
+    if (copied < 0 && errno == ENOSYS && bytes == 0) {
+      return;
+    }
+
+    fail_unless(copied >= 0, strerror(errno));
+    bytes += copied;
+  } while (copied > 0);
+
+  fail_unless(bytes == (COPY_LINES - 1) * COPY_LINE_SIZE, "bytes: %zu", bytes);
+  fail_unless(lseek(in, 0, SEEK_CUR) == COPY_LINES * COPY_LINE_SIZE);
+  fail_unless(lseek(out, 0, SEEK_CUR) == (off_t)bytes);
+
+  copy_verify(to, 0, 1);
+}
+END_TEST
+
+START_TEST(copy_multi_targets)
+{
+  int status = 0;
+  size_t bytes[3] = {0};
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *targets[3];
+  size_t i = 0;
+
+  targets[0] = to;
+  targets[1] = ccstreams_fmemopen(&buf, &buf_size, "w+");
+  fail_unless(targets[1] != NULL, strerror(errno));
+  targets[2] = tmpfile();
+  fail_unless(targets[2] != NULL, strerror(errno));
+
+  /* Chunks small enough that the ring wraps many times. */
+  status = ccstreams_copy_multi(from, targets, 3, bytes, 1000);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(feof(from));
+
+  for (i = 0; i < 3; i++) {
+    fail_unless(bytes[i] == COPY_LINES * COPY_LINE_SIZE, "bytes[%zu]: %zu", i, bytes[i]);
+    copy_verify(targets[i], 0, 0);
+  }
+
+  fclose(targets[1]);
+  fclose(targets[2]);
+  free(buf);
+}
+END_TEST
+
+START_TEST(copy_multi_write_error)
+{
+  int status = 0;
+  size_t bytes[2] = {0};
+  FILE *targets[2];
+
+  targets[0] = fopen("/dev/full", "w");
+  if (targets[0] == NULL) {
+    return;
+  }
+
+  setvbuf(targets[0], NULL, _IONBF, 0);
+  targets[1] = to;
+
+  /* The failing output is dropped, the other still gets everything. */
+  status = ccstreams_copy_multi(from, targets, 2, bytes, 4096);
+  fail_unless(status == -1);
+  fail_unless(errno == ENOSPC, strerror(errno));
+  fail_unless(bytes[0] == 0);
+  fail_unless(bytes[1] == COPY_LINES * COPY_LINE_SIZE, "bytes: %zu", bytes[1]);
+
+  copy_verify(to, 0, 0);
+
+  fclose(targets[0]);
+}
+END_TEST
+
+Suite *
+copy_suite(void)
+{
+  Suite *suite = suite_create("copy");
+
+  TCase *tc_copy = tcase_create("copy");
+
+  tcase_add_checked_fixture(tc_copy, copy_setup, copy_teardown);
+
+  tcase_add_test(tc_copy, copy_file_to_file);
+  tcase_add_test(tc_copy, copy_pipe_to_file);
+  tcase_add_test(tc_copy, copy_file_to_mem);
+  tcase_add_test(tc_copy, copy_mem_to_file);
+  tcase_add_test(tc_copy, copy_pipe_to_mem);
+  tcase_add_test(tc_copy, copy_str_to_str);
+  tcase_add_test(tc_copy, copy_with_buffer);
+  tcase_add_test(tc_copy, copy_async_pipe_to_file);
+  tcase_add_test(tc_copy, copy_async_write_error);
+  tcase_add_test(tc_copy, copy_uring);
+  tcase_add_test(tc_copy, copy_multi_targets);
+  tcase_add_test(tc_copy, copy_multi_write_error);
+
+  suite_add_tcase(suite, tc_copy);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *sr = srunner_create(copy_suite());
+
+  srunner_run_all(sr, CK_NORMAL);
+  failed = srunner_ntests_failed(sr);
+
+  srunner_free(sr);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
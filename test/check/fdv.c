@@ -0,0 +1,217 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ccstreams/fdv.h>
+
+/* Read everything available on fd without waiting. */
+static
+size_t
+fdv_drain(int fd, char *buf, size_t size)
+{
+  size_t total = 0;
+  ssize_t n = 0;
+
+  while (total < size && (n = read(fd, buf + total, size - total)) > 0) {
+    total += n;
+  }
+
+  return total;
+}
+
+START_TEST(fdv_batch)
+{
+  int fds[2];
+  char buf[4096];
+  FILE *stream = NULL;
+  size_t i = 0;
+
+  fail_unless(pipe(fds) == 0, strerror(errno));
+  fail_unless(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0, strerror(errno));
+
+  stream = ccstreams_fdvopen(fds[1], NULL);
+  fail_unless(stream != NULL, strerror(errno));
+
+  for (i = 0; i < 100; i++) {
+    fail_unless(fprintf(stream, "%08zu\n", i) == 9, strerror(errno));
+  }
+
+  /* Held until flushed (fflush doesn't get that far). */
+  fail_unless(fflush(stream) == 0, strerror(errno));
+  fail_unless(fdv_drain(fds[0], buf, sizeof(buf)) == 0);
+
+  fail_unless(ccstreams_fdv_flush(stream) == 0, strerror(errno));
+  fail_unless(fdv_drain(fds[0], buf, sizeof(buf)) == 900);
+  fail_unless(memcmp(buf + 891, "00000099\n", 9) == 0);
+
+  fail_unless(fputs("Goodbye\n", stream) >= 0, strerror(errno));
+  fail_unless(fclose(stream) == 0, strerror(errno));
+  fail_unless(fdv_drain(fds[0], buf, sizeof(buf)) == 8);
+  fail_unless(memcmp(buf, "Goodbye\n", 8) == 0);
+
+  /* Closed with the stream. */
+  fail_unless(read(fds[0], buf, 1) == 0);
+  fail_unless(close(fds[0]) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(fdv_thresholds)
+{
+  struct ccstreams_fdv_options options = {
+    .bytes = 100,
+    .segments = 0,
+  };
+  char path[] = "/tmp/ccstreams-fdv-XXXXXX";
+  char large[100000];
+  char buf[sizeof(large) + 1024];
+  int fd = -1;
+  int in = -1;
+  FILE *stream = NULL;
+  size_t i = 0;
+
+  fd = mkstemp(path);
+  fail_unless(fd != -1, strerror(errno));
+  in = open(path, O_RDONLY);
+  fail_unless(in != -1, strerror(errno));
+  unlink(path);
+
+  stream = ccstreams_fdvopen(fd, &options);
+  fail_unless(stream != NULL, strerror(errno));
+
+  /* Sent once 100 bytes are pending. */
+  for (i = 0; i < 11; i++) {
+    fail_unless(fprintf(stream, "%08zu\n", i) == 9, strerror(errno));
+  }
+
+  fail_unless(fdv_drain(in, buf, sizeof(buf)) == 0);
+  fail_unless(fprintf(stream, "%08zu\n", i) == 9, strerror(errno));
+  fail_unless(fdv_drain(in, buf, sizeof(buf)) == 108);
+
+  /* A large write goes out straight away, after what is pending. */
+  memset(large, 'x', sizeof(large));
+  fail_unless(fputs("<", stream) >= 0, strerror(errno));
+  fail_unless(fwrite(large, 1, sizeof(large), stream) == sizeof(large), strerror(errno));
+  fail_unless(fdv_drain(in, buf, sizeof(buf)) == sizeof(large) + 1);
+  fail_unless(buf[0] == '<' && buf[sizeof(large)] == 'x');
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+  fail_unless(close(in) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(fdv_error)
+{
+  int fd = -1;
+  FILE *stream = NULL;
+
+  fail_unless(ccstreams_fdv_flush(stdout) == -1);
+  fail_unless(errno == EINVAL);
+
+  fd = open("/dev/full", O_WRONLY);
+  fail_unless(fd != -1, strerror(errno));
+
+  stream = ccstreams_fdvopen(fd, NULL);
+  fail_unless(stream != NULL, strerror(errno));
+
+  fail_unless(fputs("Hello World!", stream) >= 0, strerror(errno));
+  fail_unless(ccstreams_fdv_flush(stream) == -1);
+  fail_unless(errno == ENOSPC);
+
+  fail_unless(fclose(stream) == EOF);
+}
+END_TEST
+
+START_TEST(fdv_error_continued)
+{
+  struct ccstreams_fdv_options options = {
+    .bytes = 1 << 30,
+    .segments = 2,
+  };
+  char line[1000];
+  char large[100000];
+  int fd = -1;
+  FILE *stream = NULL;
+  size_t failed = 0;
+  size_t i = 0;
+
+  fd = open("/dev/full", O_WRONLY);
+  fail_unless(fd != -1, strerror(errno));
+
+  stream = ccstreams_fdvopen(fd, &options);
+  fail_unless(stream != NULL, strerror(errno));
+
+  /* Sending fails once two chunks are pending. The writes after that are
+   * refused rather than added to the full iov.
+   */
+  memset(line, 'x', sizeof(line));
+  for (i = 0; i < 1000; i++) {
+    if (fwrite(line, 1, sizeof(line), stream) != sizeof(line)) {
+      fail_unless(errno == ENOSPC, strerror(errno));
+      clearerr(stream);
+      failed++;
+    }
+  }
+
+  fail_unless(failed > 900, "failed: %zu", failed);
+
+  /* Large writes use the spare slot and are refused the same way. */
+  memset(large, 'x', sizeof(large));
+  fail_unless(fwrite(large, 1, sizeof(large), stream) != sizeof(large));
+  fail_unless(errno == ENOSPC, strerror(errno));
+
+  fail_unless(fclose(stream) == EOF);
+}
+END_TEST
+
+Suite *
+fdv_suite(void)
+{
+  Suite *suite = suite_create("fdv");
+
+  TCase *tc_fdv = tcase_create("fdv");
+
+  tcase_add_test(tc_fdv, fdv_batch);
+  tcase_add_test(tc_fdv, fdv_thresholds);
+  tcase_add_test(tc_fdv, fdv_error);
+  tcase_add_test(tc_fdv, fdv_error_continued);
+
+  suite_add_tcase(suite, tc_fdv);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *sr = srunner_create(fdv_suite());
+
+  srunner_run_all(sr, CK_NORMAL);
+  failed = srunner_ntests_failed(sr);
+
+  srunner_free(sr);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,159 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ccstreams/map.h>
+#include <ccstreams/peek.h>
+
+#define MAP_INITIAL "Hello World!\nGoodbye World!\n"
+
+static char path[] = "/tmp/ccstreams-map-XXXXXX";
+
+static
+void
+map_setup(void)
+{
+  int fd = mkstemp(path);
+  fail_unless(fd != -1, strerror(errno));
+  fail_unless(write(fd, MAP_INITIAL, sizeof(MAP_INITIAL) - 1) == sizeof(MAP_INITIAL) - 1);
+  fail_unless(close(fd) == 0, strerror(errno));
+}
+
+static
+void
+map_teardown(void)
+{
+  unlink(path);
+  strcpy(path, "/tmp/ccstreams-map-XXXXXX");
+}
+
+START_TEST(map_read)
+{
+  char line[64];
+  FILE *stream = NULL;
+
+  stream = ccstreams_fmapopen(path, "r", 0);
+  fail_unless(stream != NULL, strerror(errno));
+
+  fail_unless(fgets(line, sizeof(line), stream) != NULL, strerror(errno));
+  fail_unless(strcmp(line, "Hello World!\n") == 0, line);
+
+  fail_unless(fseek(stream, -7, SEEK_END) == 0, strerror(errno));
+  fail_unless(fgets(line, sizeof(line), stream) != NULL, strerror(errno));
+  fail_unless(strcmp(line, "World!\n") == 0, line);
+  fail_unless(fgetc(stream) == EOF && feof(stream));
+
+  fail_unless(fseek(stream, 1, SEEK_END) == -1);
+  fail_unless(fputc('x', stream) == EOF);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(map_peek)
+{
+  const char *data = NULL;
+  size_t avail = 0;
+  FILE *stream = NULL;
+
+  stream = ccstreams_fmapopen(path, "rb", CCSTREAMS_MAP_WILLNEED);
+  fail_unless(stream != NULL, strerror(errno));
+
+  fail_unless(fgetc(stream) == 'H', strerror(errno));
+
+  fail_unless(ccstreams_peek(stream, &data, &avail) == 0, strerror(errno));
+  fail_unless(avail == sizeof(MAP_INITIAL) - 2);
+  fail_unless(memcmp(data, MAP_INITIAL + 1, avail) == 0);
+
+  fail_unless(ccstreams_consume(stream, 12) == 0, strerror(errno));
+  fail_unless(fgetc(stream) == 'G', strerror(errno));
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(map_empty)
+{
+  const char *data = NULL;
+  size_t avail = 1;
+  FILE *stream = NULL;
+
+  fail_unless(truncate(path, 0) == 0, strerror(errno));
+
+  stream = ccstreams_fmapopen(path, "r", CCSTREAMS_MAP_RANDOM);
+  fail_unless(stream != NULL, strerror(errno));
+
+  fail_unless(fgetc(stream) == EOF && feof(stream));
+  fail_unless(ccstreams_peek(stream, &data, &avail) == 0, strerror(errno));
+  fail_unless(avail == 0);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(map_invalid)
+{
+  fail_unless(ccstreams_fmapopen(path, "r+", 0) == NULL);
+  fail_unless(errno == EINVAL);
+
+  fail_unless(ccstreams_fmapopen("/tmp", "r", 0) == NULL);
+  fail_unless(errno == EINVAL);
+
+  fail_unless(ccstreams_fmapopen("/nonexistent/ccstreams", "r", 0) == NULL);
+  fail_unless(errno == ENOENT);
+}
+END_TEST
+
+Suite *
+map_suite(void)
+{
+  Suite *suite = suite_create("map");
+
+  TCase *tc_map = tcase_create("map");
+
+  tcase_add_checked_fixture(tc_map, map_setup, map_teardown);
+
+  tcase_add_test(tc_map, map_read);
+  tcase_add_test(tc_map, map_peek);
+  tcase_add_test(tc_map, map_empty);
+  tcase_add_test(tc_map, map_invalid);
+
+  suite_add_tcase(suite, tc_map);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *sr = srunner_create(map_suite());
+
+  srunner_run_all(sr, CK_NORMAL);
+  failed = srunner_ntests_failed(sr);
+
+  srunner_free(sr);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
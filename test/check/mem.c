@@ -18,10 +18,13 @@
 
 #include <check.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <ccstreams/mem.h>
+#include <ccstreams/peek.h>
+#include <ccstreams/writev.h>
 
 char *ptr = NULL;
 size_t size = 0;
@@ -128,6 +131,810 @@ START_TEST(mem_rw_write_growing)
 }
 END_TEST
 
+START_TEST(mem_options_growing)
+{
+  int status = 0;
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+  struct ccstreams_mem_options options = {
+    .capacity = 16,
+    .growth = 1.5,
+  };
+  char msg[] = "0123456789";
+  size_t i = 0;
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "w+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  status = setvbuf(buf_stream, NULL, _IONBF, 0);
+  fail_unless(status == 0, strerror(errno));
+
+  for (i = 0; i < 100; i++) {
+    fail_unless(fwrite(msg, 1, sizeof(msg) - 1, buf_stream) == sizeof(msg) - 1, strerror(errno));
+  }
+
+  fail_unless(fflush(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 100 * (sizeof(msg) - 1), "Expecting a size of %zu but got %zu.", 100 * (sizeof(msg) - 1), buf_size);
+
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 100 * (sizeof(msg) - 1), "Expecting a size of %zu but got %zu.", 100 * (sizeof(msg) - 1), buf_size);
+
+  for (i = 0; i < 100; i++) {
+    fail_unless(strncmp(buf + i * (sizeof(msg) - 1), msg, sizeof(msg) - 1) == 0);
+  }
+
+  free(buf);
+}
+END_TEST
+
+START_TEST(mem_options_empty)
+{
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+  struct ccstreams_mem_options options = {
+    .capacity = 4096,
+  };
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "a", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf != NULL);
+  fail_unless(buf_size == 0);
+
+  free(buf);
+}
+END_TEST
+
+START_TEST(mem_options_direct)
+{
+  int status = 0;
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+  struct ccstreams_mem_options options = {
+    .flags = CCSTREAMS_MEM_DIRECT,
+  };
+  char line[64];
+  size_t i = 0;
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "w+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  for (i = 0; i < 10000; i++) {
+    fail_unless(fprintf(buf_stream, "%08zu\n", i) == 9, strerror(errno));
+  }
+
+  fail_unless(fflush(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 10000 * 9, "Expecting a size of %zu but got %zu.", 10000 * 9, buf_size);
+
+  /* Overwrite in the middle and read back through stdio. */
+  status = fseek(buf_stream, 9 * 5000, SEEK_SET);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(fprintf(buf_stream, "%08d\n", -1) == 9, strerror(errno));
+
+  status = fseek(buf_stream, 9 * 4999, SEEK_SET);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(fgets(line, sizeof(line), buf_stream) != NULL, strerror(errno));
+  fail_unless(strcmp(line, "00004999\n") == 0, "line: '%s'", line);
+  fail_unless(fgets(line, sizeof(line), buf_stream) != NULL, strerror(errno));
+  fail_unless(strcmp(line, "-0000001\n") == 0, "line: '%s'", line);
+
+  /* Append after reading. */
+  status = fseek(buf_stream, 0, SEEK_END);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(fputs("end\n", buf_stream) >= 0, strerror(errno));
+
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 10000 * 9 + 4, "Expecting a size of %zu but got %zu.", 10000 * 9 + 4, buf_size);
+
+  for (i = 0; i < 10000; i++) {
+    snprintf(line, sizeof(line), "%08zu\n", i);
+    if (i == 5000) {
+      strcpy(line, "-0000001\n");
+    }
+
+    fail_unless(strncmp(buf + i * 9, line, 9) == 0, "%zu: '%.9s'", i, buf + i * 9);
+  }
+
+  fail_unless(strncmp(buf + 10000 * 9, "end\n", 4) == 0);
+
+  free(buf);
+}
+END_TEST
+
+START_TEST(mem_options_direct_setvbuf)
+{
+  int status = 0;
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+  struct ccstreams_mem_options options = {
+    .flags = CCSTREAMS_MEM_DIRECT,
+  };
+  char msg[] = "Hello World!";
+  size_t i = 0;
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "a", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  status = setvbuf(buf_stream, NULL, _IOLBF, 0);
+  fail_unless(status == 0, strerror(errno));
+
+  for (i = 0; i < 1000; i++) {
+    fail_unless(fwrite(msg, 1, sizeof(msg) - 1, buf_stream) == sizeof(msg) - 1, strerror(errno));
+  }
+
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 1000 * (sizeof(msg) - 1));
+
+  for (i = 0; i < 1000; i++) {
+    fail_unless(strncmp(buf + i * (sizeof(msg) - 1), msg, sizeof(msg) - 1) == 0);
+  }
+
+  free(buf);
+}
+END_TEST
+
+static
+void
+mem_reserve_commit(const int flags)
+{
+  int status = 0;
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+  struct ccstreams_mem_options options = {
+    .flags = flags,
+  };
+  char *out = NULL;
+  char line[64];
+  size_t i = 0;
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "w+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  for (i = 0; i < 2000; i++) {
+    if (i % 2 == 0) {
+      fail_unless(fprintf(buf_stream, "%08zu\n", i) == 9, strerror(errno));
+      continue;
+    }
+
+    status = ccstreams_mem_reserve(buf_stream, 4096, &out);
+    fail_unless(status == 0, strerror(errno));
+    fail_unless(snprintf(out, 4096, "%08zu\n", i) == 9);
+
+    status = ccstreams_mem_commit(buf_stream, 9);
+    fail_unless(status == 0, strerror(errno));
+    fail_unless(buf_size == (i + 1) * 9, "Expecting a size of %zu but got %zu.", (i + 1) * 9, buf_size);
+    fail_unless(ftell(buf_stream) == (long)buf_size);
+  }
+
+  /* Reserve in the middle and abandon the reservation. */
+  rewind(buf_stream);
+  fail_unless(fgets(line, sizeof(line), buf_stream) != NULL, strerror(errno));
+
+  status = ccstreams_mem_reserve(buf_stream, 9, &out);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(out == buf + 9);
+  fail_unless(ccstreams_mem_commit(buf_stream, 10) == -1);
+  fail_unless(errno == EINVAL);
+  fail_unless(ccstreams_mem_commit(buf_stream, 0) == 0, strerror(errno));
+  fail_unless(ftell(buf_stream) == 9);
+
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 2000 * 9, "Expecting a size of %zu but got %zu.", 2000 * 9, buf_size);
+
+  for (i = 0; i < 2000; i++) {
+    snprintf(line, sizeof(line), "%08zu\n", i);
+    fail_unless(strncmp(buf + i * 9, line, 9) == 0, "%zu: '%.9s'", i, buf + i * 9);
+  }
+
+  free(buf);
+}
+
+START_TEST(mem_options_reserve)
+{
+  mem_reserve_commit(0);
+}
+END_TEST
+
+START_TEST(mem_options_reserve_direct)
+{
+  mem_reserve_commit(CCSTREAMS_MEM_DIRECT);
+}
+END_TEST
+
+START_TEST(mem_options_reserve_invalid)
+{
+  char *out = NULL;
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+  FILE *file = tmpfile();
+  fail_unless(file != NULL, strerror(errno));
+
+  fail_unless(ccstreams_mem_reserve(file, 1, &out) == -1);
+  fail_unless(errno == EINVAL);
+
+  buf = malloc(0);
+  fail_unless(buf != NULL);
+
+  buf_stream = ccstreams_fmemopen(&buf, &buf_size, "r");
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(ccstreams_mem_reserve(buf_stream, 1, &out) == -1);
+  fail_unless(errno == EBADF);
+
+  fclose(buf_stream);
+  fclose(file);
+  free(buf);
+}
+END_TEST
+
+START_TEST(mem_options_reset)
+{
+  struct ccstreams_mem_options options = {
+    .flags = CCSTREAMS_MEM_DIRECT,
+  };
+  char *buf = NULL;
+  size_t buf_size = 0;
+  char *taken[3] = {NULL};
+  size_t taken_size[3] = {0};
+  FILE *buf_stream = NULL;
+  size_t i = 0;
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "w+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  for (i = 0; i < 3; i++) {
+    fail_unless(fprintf(buf_stream, "buffer %zu", i) > 0, strerror(errno));
+    fail_unless(fgetc(buf_stream) == EOF);
+    fail_unless(fflush(buf_stream) == 0, strerror(errno));
+
+    /* Take the buffer and start on a new one. */
+    taken[i] = buf;
+    taken_size[i] = buf_size;
+    buf = NULL;
+
+    fail_unless(ccstreams_mem_reset(buf_stream, &buf, &buf_size) == 0, strerror(errno));
+    fail_unless(feof(buf_stream) == 0);
+    fail_unless(ftell(buf_stream) == 0);
+    fail_unless(buf != NULL && buf_size == 0);
+  }
+
+  for (i = 0; i < 3; i++) {
+    char expected[16];
+
+    snprintf(expected, sizeof(expected), "buffer %zu", i);
+    fail_unless(taken_size[i] == strlen(expected), "size: %zu", taken_size[i]);
+    fail_unless(strncmp(taken[i], expected, taken_size[i]) == 0);
+    free(taken[i]);
+  }
+
+  /* Giving the same buffer again. */
+  fail_unless(fputs("again", buf_stream) >= 0, strerror(errno));
+  fail_unless(ccstreams_mem_reset(buf_stream, &buf, &buf_size) == 0, strerror(errno));
+  fail_unless(buf_size == 0, "\"w+\" truncates on reset too");
+
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  free(buf);
+
+  fail_unless(ccstreams_mem_reset(stdin, &buf, &buf_size) == -1);
+  fail_unless(errno == EINVAL);
+}
+END_TEST
+
+START_TEST(mem_options_reset_taken)
+{
+  struct ccstreams_mem_options options = {
+    .capacity = 64,
+  };
+  char *buf = NULL;
+  size_t buf_size = 0;
+  char *taken = NULL;
+  size_t taken_size = 0;
+  FILE *buf_stream = NULL;
+
+  /* Appending keeps what is in the buffer on reset, and the reserved
+   * capacity leaves the buffer larger than its data.
+   */
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "a+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  fail_unless(fputs("first", buf_stream) >= 0, strerror(errno));
+  fail_unless(fflush(buf_stream) == 0, strerror(errno));
+
+  taken = buf;
+  taken_size = buf_size;
+  buf = NULL;
+
+  fail_unless(ccstreams_mem_reset(buf_stream, &buf, &buf_size) == 0, strerror(errno));
+  fail_unless(buf != NULL && buf != taken);
+  fail_unless(buf_size == 0, "size: %zu", buf_size);
+
+  fail_unless(fputs("second", buf_stream) >= 0, strerror(errno));
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+
+  fail_unless(taken_size == 5 && strncmp(taken, "first", 5) == 0);
+  fail_unless(buf_size == 6 && strncmp(buf, "second", 6) == 0);
+
+  free(taken);
+  free(buf);
+}
+END_TEST
+
+/* An allocator that checks the sizes it is given against the sizes it
+ * handed out (kept in front of each allocation) and counts what is live.
+ * It can be made to fail allocations over a limit.
+ */
+struct counting {
+  size_t live;
+  size_t calls;
+  size_t limit;
+};
+
+static
+void *
+counting_alloc(void *context, size_t size)
+{
+  struct counting *counting = context;
+  size_t *block = NULL;
+
+  /* Refuse allocations over the limit, if one is set. */
+  if (counting->limit != 0 && size > counting->limit) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  block = malloc(sizeof(size_t) + size);
+  fail_unless(block != NULL);
+  block[0] = size;
+  counting->live++;
+  counting->calls++;
+
+  return block + 1;
+}
+
+static
+void *
+counting_grow(void *context, void *ptr, size_t old_size, size_t size)
+{
+  struct counting *counting = context;
+  size_t *block = (size_t *)ptr - 1;
+
+  fail_unless(size != 0);
+  fail_unless(block[0] == old_size, "old_size: %zu expected: %zu", old_size, block[0]);
+
+  block = realloc(block, sizeof(size_t) + size);
+  fail_unless(block != NULL);
+  block[0] = size;
+  counting->calls++;
+
+  return block + 1;
+}
+
+static
+void
+counting_free(void *context, void *ptr, size_t size)
+{
+  struct counting *counting = context;
+  size_t *block = (size_t *)ptr - 1;
+
+  fail_unless(block[0] == size, "size: %zu expected: %zu", size, block[0]);
+
+  free(block);
+  counting->live--;
+  counting->calls++;
+}
+
+START_TEST(mem_options_allocator)
+{
+  struct counting counting = {0};
+  struct ccstreams_allocator allocator = {
+    .alloc = counting_alloc,
+    .grow = counting_grow,
+    .free = counting_free,
+    .context = &counting,
+  };
+  struct ccstreams_mem_options options = {
+    .allocator = &allocator,
+  };
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+  size_t i = 0;
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "w+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(counting.live == 2);
+
+  for (i = 0; i < 10000; i++) {
+    fail_unless(fprintf(buf_stream, "%08zu\n", i) == 9, strerror(errno));
+  }
+
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 90000);
+  fail_unless(counting.live == 1);
+
+  /* Reopening truncates the buffer (freeing it with the size it has). */
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "w", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 0);
+
+  allocator.free(allocator.context, buf, buf_size);
+  fail_unless(counting.live == 0);
+}
+END_TEST
+
+START_TEST(mem_options_writev)
+{
+  struct counting counting = {0};
+  struct ccstreams_allocator allocator = {
+    .alloc = counting_alloc,
+    .grow = counting_grow,
+    .free = counting_free,
+    .context = &counting,
+  };
+  struct ccstreams_mem_options options = {
+    .allocator = &allocator,
+  };
+  struct iovec iov[20];
+  char fragments[20][8];
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+  size_t i = 0;
+
+  for (i = 0; i < 20; i++) {
+    snprintf(fragments[i], sizeof(fragments[i]), "%07zu", i);
+    iov[i].iov_base = fragments[i];
+    iov[i].iov_len = 7;
+  }
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "w+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  counting.calls = 0;
+  fail_unless(ccstreams_writev(buf_stream, iov, 20) == 140, strerror(errno));
+  fail_unless(counting.calls == 1, "calls: %zu", counting.calls);
+  fail_unless(buf_size == 140);
+  fail_unless(memcmp(buf + 7 * 19, "0000019", 7) == 0);
+  fail_unless(ftell(buf_stream) == 140);
+
+  /* Overwriting within the buffer doesn't grow it. */
+  fail_unless(fseek(buf_stream, 7, SEEK_SET) == 0, strerror(errno));
+  counting.calls = 0;
+  fail_unless(ccstreams_writev(buf_stream, iov, 2) == 14, strerror(errno));
+  fail_unless(counting.calls == 0);
+  fail_unless(buf_size == 140);
+  fail_unless(memcmp(buf, "000000000000000000001", 21) == 0);
+  fail_unless(fgetc(buf_stream) == '0');
+
+  fail_unless(ccstreams_writev(buf_stream, iov, -1) == -1);
+  fail_unless(errno == EINVAL);
+
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+
+  allocator.free(allocator.context, buf, buf_size);
+}
+END_TEST
+
+START_TEST(mem_options_mmap)
+{
+  size_t allocated = 0;
+  struct ccstreams_mem_options options = {
+    .allocator = &ccstreams_allocator_mmap_huge,
+    .allocated = &allocated,
+  };
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+  char block[4000];
+  size_t i = 0;
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "w+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  /* Enough to be remapped past the huge page threshold several times. */
+  for (i = 0; i < 4096; i++) {
+    memset(block, 'a' + i % 26, sizeof(block));
+    fail_unless(fwrite(block, 1, sizeof(block), buf_stream) == sizeof(block), strerror(errno));
+  }
+
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 4096 * sizeof(block));
+  fail_unless(((uintptr_t)buf & 4095) == 0);
+
+  for (i = 0; i < 4096; i++) {
+    fail_unless(buf[i * sizeof(block)] == 'a' + i % 26);
+    fail_unless(buf[(i + 1) * sizeof(block) - 1] == 'a' + i % 26);
+  }
+
+  ccstreams_allocator_mmap_huge.free(ccstreams_allocator_mmap_huge.context, buf, allocated);
+}
+END_TEST
+
+START_TEST(mem_options_allocated)
+{
+  struct counting counting = {0};
+  struct ccstreams_allocator allocator = {
+    .alloc = counting_alloc,
+    .grow = counting_grow,
+    .free = counting_free,
+    .context = &counting,
+  };
+  size_t allocated = 0;
+  struct ccstreams_mem_options options = {
+    .capacity = 64,
+    .allocator = &allocator,
+    .allocated = &allocated,
+  };
+  char *buf = NULL;
+  size_t buf_size = 0;
+  char *taken = NULL;
+  size_t taken_allocated = 0;
+  FILE *buf_stream = NULL;
+  char block[100];
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "a+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(allocated == 64, "allocated: %zu", allocated);
+
+  memset(block, 'x', sizeof(block));
+  fail_unless(fwrite(block, 1, sizeof(block), buf_stream) == sizeof(block), strerror(errno));
+  fail_unless(fflush(buf_stream) == 0, strerror(errno));
+  fail_unless(allocated > buf_size, "allocated: %zu size: %zu", allocated, buf_size);
+
+  /* The buffer taken before a reset is freed with its allocated size (which
+   * the counting allocator checks).
+   */
+  taken = buf;
+  taken_allocated = allocated;
+  buf = NULL;
+
+  fail_unless(ccstreams_mem_reset(buf_stream, &buf, &buf_size) == 0, strerror(errno));
+  fail_unless(allocated == 64, "allocated: %zu", allocated);
+
+  fail_unless(fputs("second", buf_stream) >= 0, strerror(errno));
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(allocated == buf_size, "allocated: %zu size: %zu", allocated, buf_size);
+
+  allocator.free(allocator.context, taken, taken_allocated);
+  allocator.free(allocator.context, buf, allocated);
+  fail_unless(counting.live == 0, "live: %zu", counting.live);
+}
+END_TEST
+
+START_TEST(mem_options_chunked)
+{
+  struct counting counting = {0};
+  struct ccstreams_allocator allocator = {
+    .alloc = counting_alloc,
+    .grow = counting_grow,
+    .free = counting_free,
+    .context = &counting,
+  };
+  struct iovec *rest = NULL;
+  size_t rest_count = 0;
+  struct ccstreams_mem_options options = {
+    .flags = CCSTREAMS_MEM_CHUNKED | CCSTREAMS_MEM_FLATTEN,
+    .allocator = &allocator,
+    .chunk = 4096,
+    .chunks = &rest,
+    .chunk_count = &rest_count,
+  };
+  char *buf = NULL;
+  size_t buf_size = 0;
+  FILE *buf_stream = NULL;
+  struct iovec iov[32];
+  size_t count = 0;
+  const char *data = NULL;
+  size_t avail = 0;
+  char *reserved = NULL;
+  char line[16];
+  size_t i = 0;
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "w+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  for (i = 0; i < 10000; i++) {
+    fail_unless(fprintf(buf_stream, "%08zu\n", i) == 9, strerror(errno));
+  }
+
+  /* 90000 bytes in an empty first chunk and 22 of 4096. */
+  count = 0;
+  fail_unless(ccstreams_mem_iov(buf_stream, NULL, &count) == 0, strerror(errno));
+  fail_unless(count == 22, "count: %zu", count);
+  fail_unless(buf_size == 90000);
+
+  count = 32;
+  fail_unless(ccstreams_mem_iov(buf_stream, iov, &count) == 0, strerror(errno));
+  fail_unless(count == 22);
+  fail_unless(iov[0].iov_len == 4096);
+  fail_unless(iov[21].iov_len == 90000 - 21 * 4096);
+
+  /* Lines straddle the chunks. */
+  fail_unless(fseek(buf_stream, 9 * 455, SEEK_SET) == 0, strerror(errno));
+  fail_unless(fgets(line, sizeof(line), buf_stream) != NULL);
+  fail_unless(strcmp(line, "00000455\n") == 0, "line: %s", line);
+
+  fail_unless(ccstreams_peek(buf_stream, &data, &avail) == 0, strerror(errno));
+  fail_unless(data == (char *)iov[1].iov_base + 9 * 456 - 4096);
+  fail_unless(avail == 2 * 4096 - 9 * 456);
+  fail_unless(ccstreams_consume(buf_stream, avail) == 0, strerror(errno));
+  fail_unless(ccstreams_peek(buf_stream, &data, &avail) == 0, strerror(errno));
+  fail_unless(data == iov[2].iov_base);
+  fail_unless(avail == 4096);
+
+  /* Overwriting across a chunk boundary. */
+  fail_unless(fseek(buf_stream, 4090, SEEK_SET) == 0, strerror(errno));
+  fail_unless(fwrite("abcdefghijkl", 1, 12, buf_stream) == 12);
+  fail_unless(fseek(buf_stream, 0, SEEK_END) == 0, strerror(errno));
+  fail_unless(ftell(buf_stream) == 90000);
+
+  fail_unless(ccstreams_mem_flatten(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 90000);
+  fail_unless(memcmp(buf + 4086, "0000abcdefghijkl5\n", 18) == 0);
+  fail_unless(memcmp(buf + 90000 - 9, "00009999\n", 9) == 0);
+
+  count = 32;
+  fail_unless(ccstreams_mem_iov(buf_stream, iov, &count) == 0, strerror(errno));
+  fail_unless(count == 1);
+  fail_unless(iov[0].iov_base == buf);
+
+  /* And it carries on growing in chunks. */
+  fail_unless(fprintf(buf_stream, "%08d\n", 10000) == 9, strerror(errno));
+  fail_unless(ccstreams_mem_reserve(buf_stream, 1, &reserved) == -1);
+  fail_unless(errno == EINVAL);
+
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 90009);
+  fail_unless(memcmp(buf + 90000, "00010000\n", 9) == 0);
+  fail_unless(rest == NULL && rest_count == 0);
+  fail_unless(counting.live == 1);
+
+  allocator.free(allocator.context, buf, buf_size);
+  fail_unless(counting.live == 0);
+}
+END_TEST
+
+START_TEST(mem_options_chunked_existing)
+{
+  struct iovec *rest = NULL;
+  size_t rest_count = 0;
+  struct ccstreams_mem_options options = {
+    .flags = CCSTREAMS_MEM_CHUNKED,
+    .chunk = 8,
+  };
+  char *buf = strdup("Hello");
+  size_t buf_size = 5;
+  FILE *buf_stream = NULL;
+  struct iovec iov[2];
+  size_t count = 2;
+
+  fail_unless(buf != NULL);
+
+  /* The chunks must have somewhere to go on close. */
+  fail_unless(ccstreams_fmemopen_options(&buf, &buf_size, "a", &options) == NULL);
+  fail_unless(errno == EINVAL, strerror(errno));
+
+  options.chunks = &rest;
+  options.chunk_count = &rest_count;
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "a", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(fputs(", World!", buf_stream) >= 0, strerror(errno));
+
+  fail_unless(ccstreams_mem_iov(buf_stream, iov, &count) == 0, strerror(errno));
+  fail_unless(count == 2);
+  fail_unless(iov[0].iov_base == buf);
+  fail_unless(iov[0].iov_len == 5);
+
+  /* Without CCSTREAMS_MEM_FLATTEN closing hands back the same segments. */
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf_size == 5);
+  fail_unless(memcmp(buf, "Hello", 5) == 0);
+  fail_unless(rest_count == 1);
+  fail_unless(rest[0].iov_base == iov[1].iov_base);
+  fail_unless(rest[0].iov_len == 8);
+  fail_unless(memcmp(rest[0].iov_base, ", World!", 8) == 0);
+
+  free(rest[0].iov_base);
+  free(rest);
+  free(buf);
+}
+END_TEST
+
+START_TEST(mem_options_chunked_close_error)
+{
+  struct counting counting = {0};
+  struct ccstreams_allocator allocator = {
+    .alloc = counting_alloc,
+    .grow = counting_grow,
+    .free = counting_free,
+    .context = &counting,
+  };
+  struct iovec *rest = NULL;
+  size_t rest_count = 0;
+  struct ccstreams_mem_options options = {
+    .flags = CCSTREAMS_MEM_CHUNKED | CCSTREAMS_MEM_FLATTEN,
+    .chunk = 32,
+    .allocator = &allocator,
+    .chunks = &rest,
+    .chunk_count = &rest_count,
+  };
+  char filler[100];
+  char *buf = NULL;
+  size_t buf_size = 5;
+  FILE *buf_stream = NULL;
+  size_t i = 0;
+
+  buf = allocator.alloc(allocator.context, buf_size);
+  memcpy(buf, "Hello", buf_size);
+
+  buf_stream = ccstreams_fmemopen_options(&buf, &buf_size, "r+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  /* Changes to the first chunk are kept, as are the chunks after it. */
+  memset(filler, '.', sizeof(filler));
+  fail_unless(fputc('J', buf_stream) == 'J', strerror(errno));
+  fail_unless(fseek(buf_stream, 0, SEEK_END) == 0, strerror(errno));
+  fail_unless(fwrite(filler, 1, sizeof(filler), buf_stream) == sizeof(filler), strerror(errno));
+
+  /* Gathering the chunks is the only allocation that large. */
+  counting.limit = 64;
+
+  fail_unless(fclose(buf_stream) == EOF);
+  fail_unless(errno == ENOMEM, strerror(errno));
+  fail_unless(buf_size == 5, "size: %zu", buf_size);
+  fail_unless(memcmp(buf, "Jello", 5) == 0);
+
+  /* 100 bytes in chunks of 32, the last shrunk to fit. */
+  fail_unless(rest_count == 4, "count: %zu", rest_count);
+  fail_unless(rest[3].iov_len == 4, "len: %zu", rest[3].iov_len);
+
+  for (i = 0; i < rest_count; i++) {
+    fail_unless(memcmp(rest[i].iov_base, filler, rest[i].iov_len) == 0);
+    allocator.free(allocator.context, rest[i].iov_base, rest[i].iov_len);
+  }
+
+  allocator.free(allocator.context, rest, rest_count * sizeof(*rest));
+  allocator.free(allocator.context, buf, buf_size);
+  fail_unless(counting.live == 0, "live: %zu", counting.live);
+}
+END_TEST
+
+START_TEST(mem_rw_peek)
+{
+  int status = 0;
+  const char *data = NULL;
+  size_t avail = 0;
+  char buf[1024];
+
+  /* Let stdio read ahead first. */
+  fail_unless(fgetc(stream) == 'H', strerror(errno));
+
+  status = ccstreams_peek(stream, &data, &avail);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(data == ptr + 1);
+  fail_unless(avail == sizeof(MEM_RW_INITIAL) - 1);
+
+  status = ccstreams_consume(stream, 5);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(ftell(stream) == 6);
+  fail_unless(fread(buf, 1, sizeof(buf), stream) == sizeof(MEM_RW_INITIAL) - 6);
+  fail_unless(strcmp(buf, "World!") == 0);
+
+  status = ccstreams_peek(stream, &data, &avail);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(avail == 0);
+  fail_unless(ccstreams_consume(stream, 1) == -1);
+  fail_unless(errno == EINVAL);
+}
+END_TEST
+
 Suite *
 mem_suite(void)
 {
@@ -142,9 +949,31 @@ mem_suite(void)
   tcase_add_test(tc_mem_rw, mem_rw_tell);
   tcase_add_test(tc_mem_rw, mem_rw_seek);
   tcase_add_test(tc_mem_rw, mem_rw_write_growing);
+  tcase_add_test(tc_mem_rw, mem_rw_peek);
 
   suite_add_tcase(suite, tc_mem_rw);
 
+  TCase *tc_mem_options = tcase_create("mem options");
+
+  tcase_add_test(tc_mem_options, mem_options_growing);
+  tcase_add_test(tc_mem_options, mem_options_empty);
+  tcase_add_test(tc_mem_options, mem_options_direct);
+  tcase_add_test(tc_mem_options, mem_options_direct_setvbuf);
+  tcase_add_test(tc_mem_options, mem_options_reserve);
+  tcase_add_test(tc_mem_options, mem_options_reserve_direct);
+  tcase_add_test(tc_mem_options, mem_options_reserve_invalid);
+  tcase_add_test(tc_mem_options, mem_options_allocator);
+  tcase_add_test(tc_mem_options, mem_options_reset);
+  tcase_add_test(tc_mem_options, mem_options_reset_taken);
+  tcase_add_test(tc_mem_options, mem_options_writev);
+  tcase_add_test(tc_mem_options, mem_options_mmap);
+  tcase_add_test(tc_mem_options, mem_options_allocated);
+  tcase_add_test(tc_mem_options, mem_options_chunked);
+  tcase_add_test(tc_mem_options, mem_options_chunked_existing);
+  tcase_add_test(tc_mem_options, mem_options_chunked_close_error);
+
+  suite_add_tcase(suite, tc_mem_options);
+
   return suite;
 }
 
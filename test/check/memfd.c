@@ -0,0 +1,164 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <ccstreams/memfd.h>
+#include <ccstreams/peek.h>
+
+START_TEST(memfd_write_seal)
+{
+  int fd = -1;
+  struct stat st;
+  size_t i = 0;
+  FILE *stream = NULL;
+
+  stream = ccstreams_fmemfdopen(&fd, "w+");
+  fail_unless(stream != NULL, strerror(errno));
+  fail_unless(fd != -1);
+
+  for (i = 0; i < 10000; i++) {
+    fail_unless(fprintf(stream, "%08zu\n", i) == 9, strerror(errno));
+  }
+
+  fail_unless(fseek(stream, 0, SEEK_SET) == 0, strerror(errno));
+  fail_unless(fputs("xxxxxxxx\n", stream) >= 0, strerror(errno));
+  fail_unless(fseek(stream, 1, SEEK_END) == -1);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+
+  fail_unless(fstat(fd, &st) == 0, strerror(errno));
+  fail_unless(st.st_size == 90000);
+
+  fail_unless(fcntl(fd, F_GET_SEALS) == (F_SEAL_WRITE | F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL));
+  fail_unless(pwrite(fd, "y", 1, 0) == -1);
+  fail_unless(errno == EPERM);
+
+  fail_unless(close(fd) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(memfd_handoff)
+{
+  int fd = -1;
+  int status = 0;
+  pid_t pid = 0;
+  FILE *stream = NULL;
+
+  stream = ccstreams_fmemfdopen(&fd, "w");
+  fail_unless(stream != NULL, strerror(errno));
+  fail_unless(fputs("Hello World!\n", stream) >= 0, strerror(errno));
+  fail_unless(fclose(stream) == 0, strerror(errno));
+
+  /* The child reads the data through the descriptor it inherited. */
+  pid = fork();
+  fail_unless(pid != -1, strerror(errno));
+
+  if (pid == 0) {
+    const char *data = NULL;
+    size_t avail = 0;
+
+    stream = ccstreams_fmemfdopen(&fd, "r");
+    if (stream == NULL) _exit(1);
+    if (ccstreams_peek(stream, &data, &avail) != 0) _exit(2);
+    if (avail != 13 || memcmp(data, "Hello World!\n", 13) != 0) _exit(3);
+    if (ccstreams_consume(stream, 6) != 0) _exit(4);
+    if (fgetc(stream) != 'W') _exit(5);
+    if (fputc('x', stream) != EOF) _exit(6);
+    if (fclose(stream) != 0) _exit(7);
+    _exit(0);
+  }
+
+  fail_unless(waitpid(pid, &status, 0) == pid, strerror(errno));
+  fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == 0, "status: %d", status);
+
+  fail_unless(close(fd) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(memfd_empty)
+{
+  int fd = -1;
+  FILE *stream = NULL;
+
+  stream = ccstreams_fmemfdopen(&fd, "a");
+  fail_unless(stream != NULL, strerror(errno));
+  fail_unless(fclose(stream) == 0, strerror(errno));
+
+  stream = ccstreams_fmemfdopen(&fd, "r");
+  fail_unless(stream != NULL, strerror(errno));
+  fail_unless(fgetc(stream) == EOF && feof(stream));
+  fail_unless(fclose(stream) == 0, strerror(errno));
+
+  fail_unless(close(fd) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(memfd_invalid)
+{
+  int fd = -1;
+
+  fail_unless(ccstreams_fmemfdopen(&fd, "r") == NULL);
+  fail_unless(errno == EINVAL);
+  fail_unless(fd == -1);
+
+  fd = STDIN_FILENO;
+  fail_unless(ccstreams_fmemfdopen(&fd, "w") == NULL);
+  fail_unless(errno == EINVAL);
+  fail_unless(fd == STDIN_FILENO);
+}
+END_TEST
+
+Suite *
+memfd_suite(void)
+{
+  Suite *suite = suite_create("memfd");
+
+  TCase *tc_memfd = tcase_create("memfd");
+
+  tcase_add_test(tc_memfd, memfd_write_seal);
+  tcase_add_test(tc_memfd, memfd_handoff);
+  tcase_add_test(tc_memfd, memfd_empty);
+  tcase_add_test(tc_memfd, memfd_invalid);
+
+  suite_add_tcase(suite, tc_memfd);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *sr = srunner_create(memfd_suite());
+
+  srunner_run_all(sr, CK_NORMAL);
+  failed = srunner_ntests_failed(sr);
+
+  srunner_free(sr);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,149 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccstreams/pipe.h>
+
+#define PIPE_LINES 100000
+
+static
+void *
+pipe_producer(void *arg)
+{
+  FILE *writer = arg;
+  size_t i = 0;
+
+  for (i = 0; i < PIPE_LINES; i++) {
+    if (fprintf(writer, "%08zu\n", i) != 9) break;
+  }
+
+  fclose(writer);
+
+  return NULL;
+}
+
+START_TEST(pipe_threads)
+{
+  FILE *reader = NULL;
+  FILE *writer = NULL;
+  pthread_t producer;
+  char line[16];
+  char expected[16];
+  size_t i = 0;
+
+  /* Small enough that both ends have to wait on each other. */
+  fail_unless(ccstreams_fpipeopen(&reader, &writer, 100, 0) == 0, strerror(errno));
+  fail_unless(pthread_create(&producer, NULL, pipe_producer, writer) == 0);
+
+  for (i = 0; i < PIPE_LINES; i++) {
+    fail_unless(fgets(line, sizeof(line), reader) != NULL, "line %zu: %s", i, strerror(errno));
+    snprintf(expected, sizeof(expected), "%08zu\n", i);
+    fail_unless(strcmp(line, expected) == 0, "line: %s expected: %s", line, expected);
+  }
+
+  fail_unless(fgetc(reader) == EOF && feof(reader));
+
+  fail_unless(pthread_join(producer, NULL) == 0);
+  fail_unless(fclose(reader) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(pipe_nonblock)
+{
+  FILE *reader = NULL;
+  FILE *writer = NULL;
+  char block[5000];
+  char buf[8192];
+
+  fail_unless(ccstreams_fpipeopen(&reader, &writer, 4096, CCSTREAMS_PIPE_NONBLOCK) == 0, strerror(errno));
+
+  /* Nothing there yet. */
+  fail_unless(fgetc(reader) == EOF && ferror(reader));
+  fail_unless(errno == EAGAIN);
+  clearerr(reader);
+
+  /* Only as much as fits goes in. */
+  memset(block, 'x', sizeof(block));
+  fail_unless(fwrite(block, 1, sizeof(block), writer) == 4096);
+  fail_unless(ferror(writer) && errno == EAGAIN);
+  clearerr(writer);
+
+  fail_unless(fread(buf, 1, sizeof(buf), reader) == 4096);
+  fail_unless(memcmp(buf, block, 4096) == 0);
+  clearerr(reader);
+
+  fail_unless(fwrite(block, 1, 904, writer) == 904, strerror(errno));
+  fail_unless(fclose(writer) == 0, strerror(errno));
+
+  fail_unless(fread(buf, 1, sizeof(buf), reader) == 904);
+  fail_unless(feof(reader) && !ferror(reader));
+  fail_unless(fclose(reader) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(pipe_reader_closed)
+{
+  FILE *reader = NULL;
+  FILE *writer = NULL;
+
+  fail_unless(ccstreams_fpipeopen(&reader, &writer, 0, 0) == 0, strerror(errno));
+  fail_unless(fclose(reader) == 0, strerror(errno));
+
+  fail_unless(fputs("Hello World!", writer) >= 0);
+  fail_unless(fflush(writer) == EOF);
+  fail_unless(errno == EPIPE);
+
+  fclose(writer);
+}
+END_TEST
+
+Suite *
+pipe_suite(void)
+{
+  Suite *suite = suite_create("pipe");
+
+  TCase *tc_pipe = tcase_create("pipe");
+
+  tcase_add_test(tc_pipe, pipe_threads);
+  tcase_add_test(tc_pipe, pipe_nonblock);
+  tcase_add_test(tc_pipe, pipe_reader_closed);
+
+  suite_add_tcase(suite, tc_pipe);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *sr = srunner_create(pipe_suite());
+
+  srunner_run_all(sr, CK_NORMAL);
+  failed = srunner_ntests_failed(sr);
+
+  srunner_free(sr);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,141 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccstreams/ring.h>
+
+START_TEST(ring_overwrite)
+{
+  struct iovec segments[2];
+  char expected[16 * 1024];
+  char held[64];
+  size_t length = 0;
+  FILE *stream = NULL;
+  size_t i = 0;
+
+  stream = ccstreams_fringopen(64, "w");
+  fail_unless(stream != NULL, strerror(errno));
+
+  fail_unless(fputs("Hello World!\n", stream) >= 0, strerror(errno));
+  fail_unless(ccstreams_ring_snapshot(stream, segments) == 0, strerror(errno));
+  fail_unless(segments[0].iov_len == 13);
+  fail_unless(memcmp(segments[0].iov_base, "Hello World!\n", 13) == 0);
+  fail_unless(segments[1].iov_len == 0);
+
+  length = 13;
+  for (i = 0; i < 1000; i++) {
+    fail_unless(fprintf(stream, "%08zu\n", i) == 9, strerror(errno));
+    length += snprintf(expected + length, sizeof(expected) - length, "%08zu\n", i);
+  }
+
+  /* Only the last 64 bytes are kept, wrapped around. */
+  fail_unless(ccstreams_ring_snapshot(stream, segments) == 0, strerror(errno));
+  fail_unless(segments[0].iov_len + segments[1].iov_len == 64);
+  fail_unless(segments[1].iov_len == length % 64);
+
+  memcpy(held, segments[0].iov_base, segments[0].iov_len);
+  memcpy(held + segments[0].iov_len, segments[1].iov_base, segments[1].iov_len);
+  fail_unless(memcmp(held, expected + length - 64, 64) == 0);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(ring_read)
+{
+  char buf[128];
+  FILE *stream = NULL;
+  struct iovec segments[2];
+
+  stream = ccstreams_fringopen(16, "w+");
+  fail_unless(stream != NULL, strerror(errno));
+
+  /* A write larger than the buffer keeps its end. */
+  fail_unless(fputs("0123456789abcdefghijklmnopqrstuvwxyz", stream) >= 0, strerror(errno));
+  fail_unless(fflush(stream) == 0, strerror(errno));
+
+  fail_unless(fread(buf, 1, sizeof(buf), stream) == 16);
+  fail_unless(memcmp(buf, "klmnopqrstuvwxyz", 16) == 0);
+  fail_unless(feof(stream));
+
+  /* Reads are consumed, output carries on at the end. */
+  fail_unless(ccstreams_ring_snapshot(stream, segments) == 0, strerror(errno));
+  fail_unless(segments[0].iov_len == 0 && segments[1].iov_len == 0);
+
+  fail_unless(fputs("!?", stream) >= 0, strerror(errno));
+  fail_unless(fflush(stream) == 0, strerror(errno));
+  clearerr(stream);
+  fail_unless(fread(buf, 1, sizeof(buf), stream) == 2);
+  fail_unless(memcmp(buf, "!?", 2) == 0);
+
+  fail_unless(fseek(stream, 0, SEEK_SET) == -1);
+  fail_unless(errno == ESPIPE);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(ring_invalid)
+{
+  struct iovec segments[2];
+
+  fail_unless(ccstreams_fringopen(0, "w") == NULL);
+  fail_unless(errno == EINVAL);
+
+  fail_unless(ccstreams_fringopen(16, "r") == NULL);
+  fail_unless(errno == EINVAL);
+
+  fail_unless(ccstreams_ring_snapshot(stdout, segments) == -1);
+  fail_unless(errno == EINVAL);
+}
+END_TEST
+
+Suite *
+ring_suite(void)
+{
+  Suite *suite = suite_create("ring");
+
+  TCase *tc_ring = tcase_create("ring");
+
+  tcase_add_test(tc_ring, ring_overwrite);
+  tcase_add_test(tc_ring, ring_read);
+  tcase_add_test(tc_ring, ring_invalid);
+
+  suite_add_tcase(suite, tc_ring);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *sr = srunner_create(ring_suite());
+
+  srunner_run_all(sr, CK_NORMAL);
+  failed = srunner_ntests_failed(sr);
+
+  srunner_free(sr);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
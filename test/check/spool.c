@@ -0,0 +1,190 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ccstreams/peek.h>
+#include <ccstreams/spool.h>
+
+START_TEST(spool_memory)
+{
+  struct ccstreams_spool_options options = {
+    .threshold = 64,
+  };
+  char line[64];
+  int fd = 0;
+  const char *data = NULL;
+  size_t avail = 0;
+  FILE *stream = NULL;
+
+  stream = ccstreams_fspoolopen("w+", &options);
+  fail_unless(stream != NULL, strerror(errno));
+
+  fail_unless(fputs("Hello World!\n", stream) >= 0, strerror(errno));
+  fail_unless(ccstreams_spool_fd(stream, &fd) == 0, strerror(errno));
+  fail_unless(fd == -1);
+
+  rewind(stream);
+  fail_unless(fgets(line, sizeof(line), stream) != NULL, strerror(errno));
+  fail_unless(strcmp(line, "Hello World!\n") == 0, line);
+
+  fail_unless(fseek(stream, 1, SEEK_END) == -1);
+  fail_unless(errno == EINVAL);
+
+  /* Not a peekable stream, the data may be on disk. */
+  fail_unless(ccstreams_peek(stream, &data, &avail) == -1);
+  fail_unless(errno == EINVAL);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(spool_spill)
+{
+  struct ccstreams_spool_options options = {
+    .threshold = 4096,
+    .directory = "/tmp",
+  };
+  char line[64];
+  int fd = -1;
+  struct stat st;
+  size_t i = 0;
+  FILE *stream = NULL;
+
+  stream = ccstreams_fspoolopen("w+", &options);
+  fail_unless(stream != NULL, strerror(errno));
+
+  for (i = 0; i < 1000; i++) {
+    fail_unless(fprintf(stream, "%08zu\n", i) == 9, strerror(errno));
+  }
+
+  fail_unless(ccstreams_spool_fd(stream, &fd) == 0, strerror(errno));
+  fail_unless(fd != -1);
+  fail_unless(fstat(fd, &st) == 0, strerror(errno));
+  fail_unless(st.st_size == 9000);
+  fail_unless(st.st_nlink == 0);
+
+  /* Reading and overwriting carry on in the file. */
+  fail_unless(fseek(stream, 9 * 10, SEEK_SET) == 0, strerror(errno));
+  fail_unless(fgets(line, sizeof(line), stream) != NULL, strerror(errno));
+  fail_unless(strcmp(line, "00000010\n") == 0, line);
+
+  fail_unless(fseek(stream, 0, SEEK_SET) == 0, strerror(errno));
+  fail_unless(fputs("xxxxxxxx\n", stream) >= 0, strerror(errno));
+  fail_unless(fseek(stream, 0, SEEK_END) == 0, strerror(errno));
+  fail_unless(ftell(stream) == 9000);
+
+  rewind(stream);
+  fail_unless(fgets(line, sizeof(line), stream) != NULL, strerror(errno));
+  fail_unless(strcmp(line, "xxxxxxxx\n") == 0, line);
+  fail_unless(fgets(line, sizeof(line), stream) != NULL, strerror(errno));
+  fail_unless(strcmp(line, "00000001\n") == 0, line);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(spool_append)
+{
+  struct ccstreams_spool_options options = {
+    .threshold = 16,
+  };
+  char buf[64];
+  int fd = -1;
+  FILE *stream = NULL;
+
+  stream = ccstreams_fspoolopen("a+", &options);
+  fail_unless(stream != NULL, strerror(errno));
+
+  fail_unless(fputs("Hello ", stream) >= 0, strerror(errno));
+  fail_unless(fflush(stream) == 0, strerror(errno));
+
+  /* Appends land at the end wherever the stream is. */
+  rewind(stream);
+  fail_unless(fputs("World, spilled!", stream) >= 0, strerror(errno));
+  fail_unless(ccstreams_spool_fd(stream, &fd) == 0, strerror(errno));
+  fail_unless(fd != -1);
+
+  rewind(stream);
+  fail_unless(fread(buf, 1, sizeof(buf), stream) == 21);
+  fail_unless(memcmp(buf, "Hello World, spilled!", 21) == 0);
+
+  fail_unless(fclose(stream) == 0, strerror(errno));
+}
+END_TEST
+
+START_TEST(spool_invalid)
+{
+  struct ccstreams_spool_options options = {
+    .threshold = 4,
+    .directory = "/nonexistent/ccstreams",
+  };
+  int fd = 0;
+  FILE *stream = NULL;
+
+  fail_unless(ccstreams_spool_fd(stdout, &fd) == -1);
+  fail_unless(errno == EINVAL);
+
+  stream = ccstreams_fspoolopen("w", &options);
+  fail_unless(stream != NULL, strerror(errno));
+  setvbuf(stream, NULL, _IONBF, 0);
+
+  /* Spilling fails, so the write does. */
+  fail_unless(fputs("Hello World!", stream) == EOF);
+  fail_unless(ferror(stream));
+
+  fclose(stream);
+}
+END_TEST
+
+Suite *
+spool_suite(void)
+{
+  Suite *suite = suite_create("spool");
+
+  TCase *tc_spool = tcase_create("spool");
+
+  tcase_add_test(tc_spool, spool_memory);
+  tcase_add_test(tc_spool, spool_spill);
+  tcase_add_test(tc_spool, spool_append);
+  tcase_add_test(tc_spool, spool_invalid);
+
+  suite_add_tcase(suite, tc_spool);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *sr = srunner_create(spool_suite());
+
+  srunner_run_all(sr, CK_NORMAL);
+  failed = srunner_ntests_failed(sr);
+
+  srunner_free(sr);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -21,7 +21,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <ccstreams/peek.h>
 #include <ccstreams/str.h>
+#include <ccstreams/writev.h>
 
 char *str = NULL;
 FILE *stream = NULL;
@@ -137,6 +139,361 @@ START_TEST(str_rw_write_shrinking)
 }
 END_TEST
 
+START_TEST(str_options_reopen)
+{
+  char *buf = NULL;
+  size_t length = 0;
+  size_t capacity = 0;
+  FILE *buf_stream = NULL;
+  struct ccstreams_str_options options = {
+    .length = &length,
+    .capacity = &capacity,
+  };
+  char msg[] = "0123456789";
+  size_t i = 0;
+
+  for (i = 0; i < 100; i++) {
+    buf_stream = ccstreams_fstropen_options(&buf, "a", &options);
+    fail_unless(buf_stream != NULL, strerror(errno));
+    fail_unless(length == i * (sizeof(msg) - 1), "Expecting a length of %zu but got %zu.", i * (sizeof(msg) - 1), length);
+
+    fail_unless(fputs(msg, buf_stream) >= 0, strerror(errno));
+    fail_unless(fclose(buf_stream) == 0, strerror(errno));
+
+    fail_unless(length == strlen(buf), "Expecting a length of %zu but got %zu.", strlen(buf), length);
+    fail_unless(capacity > length);
+  }
+
+  for (i = 0; i < 100; i++) {
+    fail_unless(strncmp(buf + i * (sizeof(msg) - 1), msg, sizeof(msg) - 1) == 0);
+  }
+
+  buf_stream = ccstreams_fstropen_options(&buf, "w", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(length == 0);
+  fail_unless(buf[0] == '\0');
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+
+  free(buf);
+}
+END_TEST
+
+START_TEST(str_options_reset)
+{
+  char *buf = NULL;
+  FILE *buf_stream = NULL;
+  char *taken[3] = {NULL};
+  char line[64];
+  size_t i = 0;
+
+  buf_stream = ccstreams_fstropen(&buf, "a+");
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  for (i = 0; i < 3; i++) {
+    fail_unless(fprintf(buf_stream, "string %zu", i) > 0, strerror(errno));
+    fail_unless(fflush(buf_stream) == 0, strerror(errno));
+
+    /* Take the string and start on a new one. */
+    taken[i] = buf;
+    buf = NULL;
+
+    fail_unless(ccstreams_str_reset(buf_stream, &buf) == 0, strerror(errno));
+    fail_unless(buf != NULL && buf[0] == '\0');
+  }
+
+  for (i = 0; i < 3; i++) {
+    char expected[16];
+
+    snprintf(expected, sizeof(expected), "string %zu", i);
+    fail_unless(strcmp(taken[i], expected) == 0, taken[i]);
+    free(taken[i]);
+  }
+
+  free(buf);
+
+  /* Retarget at an existing string and read it from the start. */
+  buf = strdup("Hello World!");
+  fail_unless(ccstreams_str_reset(buf_stream, &buf) == 0, strerror(errno));
+  fail_unless(fgets(line, sizeof(line), buf_stream) != NULL, strerror(errno));
+  fail_unless(strcmp(line, "Hello World!") == 0, line);
+
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  free(buf);
+}
+END_TEST
+
+START_TEST(str_options_reset_taken)
+{
+  char *buf = NULL;
+  char *taken = NULL;
+  FILE *buf_stream = NULL;
+
+  buf_stream = ccstreams_fstropen(&buf, "a+");
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  /* Growing in steps leaves the string larger than it needs to be. */
+  fail_unless(fputs("fir", buf_stream) >= 0, strerror(errno));
+  fail_unless(fflush(buf_stream) == 0, strerror(errno));
+  fail_unless(fputs("st", buf_stream) >= 0, strerror(errno));
+  fail_unless(fflush(buf_stream) == 0, strerror(errno));
+
+  taken = buf;
+  buf = NULL;
+
+  fail_unless(ccstreams_str_reset(buf_stream, &buf) == 0, strerror(errno));
+  fail_unless(buf != taken);
+
+  fail_unless(fputs("second", buf_stream) >= 0, strerror(errno));
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+
+  fail_unless(strcmp(taken, "first") == 0, taken);
+  fail_unless(strcmp(buf, "second") == 0, buf);
+
+  free(taken);
+  free(buf);
+}
+END_TEST
+
+/* An allocator that checks the sizes it is given against the sizes it
+ * handed out (kept in front of each allocation) and counts what is live.
+ */
+struct counting {
+  size_t live;
+  size_t calls;
+};
+
+static
+void *
+counting_alloc(void *context, size_t size)
+{
+  struct counting *counting = context;
+  size_t *block = malloc(sizeof(size_t) + size);
+
+  fail_unless(block != NULL);
+  block[0] = size;
+  counting->live++;
+  counting->calls++;
+
+  return block + 1;
+}
+
+static
+void *
+counting_grow(void *context, void *ptr, size_t old_size, size_t size)
+{
+  struct counting *counting = context;
+  size_t *block = (size_t *)ptr - 1;
+
+  fail_unless(size != 0);
+  fail_unless(block[0] == old_size, "old_size: %zu expected: %zu", old_size, block[0]);
+
+  block = realloc(block, sizeof(size_t) + size);
+  fail_unless(block != NULL);
+  block[0] = size;
+  counting->calls++;
+
+  return block + 1;
+}
+
+static
+void
+counting_free(void *context, void *ptr, size_t size)
+{
+  struct counting *counting = context;
+  size_t *block = (size_t *)ptr - 1;
+
+  fail_unless(block[0] == size, "size: %zu expected: %zu", size, block[0]);
+
+  free(block);
+  counting->live--;
+  counting->calls++;
+}
+
+START_TEST(str_options_allocator)
+{
+  struct counting counting = {0};
+  struct ccstreams_allocator allocator = {
+    .alloc = counting_alloc,
+    .grow = counting_grow,
+    .free = counting_free,
+    .context = &counting,
+  };
+  struct ccstreams_str_options options = {
+    .allocator = &allocator,
+  };
+  char *buf = NULL;
+  FILE *buf_stream = NULL;
+  size_t i = 0;
+
+  buf_stream = ccstreams_fstropen_options(&buf, "a", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(counting.live == 2);
+
+  for (i = 0; i < 10000; i++) {
+    fail_unless(fprintf(buf_stream, "%08zu\n", i) == 9, strerror(errno));
+  }
+
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(strlen(buf) == 90000);
+  fail_unless(counting.live == 1);
+
+  /* Reopening truncates the string (shrinking it from its full size). */
+  buf_stream = ccstreams_fstropen_options(&buf, "w", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf[0] == '\0');
+
+  allocator.free(allocator.context, buf, 1);
+  fail_unless(counting.live == 0);
+}
+END_TEST
+
+START_TEST(str_options_writev)
+{
+  struct counting counting = {0};
+  struct ccstreams_allocator allocator = {
+    .alloc = counting_alloc,
+    .grow = counting_grow,
+    .free = counting_free,
+    .context = &counting,
+  };
+  struct ccstreams_str_options options = {
+    .allocator = &allocator,
+  };
+  struct iovec iov[] = {
+    {"Hello", 5},
+    {", ", 2},
+    {"", 0},
+    {"World", 5},
+    {"!", 1},
+  };
+  char *buf = NULL;
+  FILE *buf_stream = NULL;
+
+  buf_stream = ccstreams_fstropen_options(&buf, "w+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+
+  /* Output still in stdio goes first. */
+  fail_unless(fputs(">> ", buf_stream) >= 0, strerror(errno));
+  fail_unless(ccstreams_writev(buf_stream, iov, 5) == 13, strerror(errno));
+  fail_unless(strcmp(buf, ">> Hello, World!") == 0, buf);
+  fail_unless(ftell(buf_stream) == 16);
+
+  /* One allocation for the output before and one growth for all of it. */
+  counting.calls = 0;
+  fail_unless(ccstreams_writev(buf_stream, iov, 5) == 13, strerror(errno));
+  fail_unless(counting.calls == 1, "calls: %zu", counting.calls);
+
+  fail_unless(fputc('.', buf_stream) == '.', strerror(errno));
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(strcmp(buf, ">> Hello, World!Hello, World!.") == 0, buf);
+
+  allocator.free(allocator.context, buf, strlen(buf) + 1);
+}
+END_TEST
+
+START_TEST(str_options_lazy)
+{
+  struct counting counting = {0};
+  struct ccstreams_allocator allocator = {
+    .alloc = counting_alloc,
+    .grow = counting_grow,
+    .free = counting_free,
+    .context = &counting,
+  };
+  struct ccstreams_str_options options = {
+    .allocator = &allocator,
+    .flags = CCSTREAMS_STR_LAZY,
+  };
+  char *buf = NULL;
+  char *other = NULL;
+  FILE *buf_stream = NULL;
+
+  /* Only the cookie until the first write, which allocates once. */
+  buf_stream = ccstreams_fstropen_options(&buf, "w+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(counting.calls == 1);
+  fail_unless(buf == NULL);
+
+  fail_unless(fputs("Hello World!", buf_stream) >= 0, strerror(errno));
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(strcmp(buf, "Hello World!") == 0);
+  fail_unless(counting.calls == 3, "calls: %zu", counting.calls);
+
+  allocator.free(allocator.context, buf, strlen(buf) + 1);
+  buf = NULL;
+
+  /* Closing without writing still hands back an allocated string. */
+  buf_stream = ccstreams_fstropen_options(&buf, "a", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(buf != NULL && buf[0] == '\0');
+
+  allocator.free(allocator.context, buf, 1);
+  buf = NULL;
+
+  /* Resetting without writing: with the same variable there is nothing to
+   * hand back, with another the old string is left as on close.
+   */
+  buf_stream = ccstreams_fstropen_options(&buf, "a+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(fflush(buf_stream) == 0, strerror(errno));
+  fail_unless(buf == NULL);
+
+  fail_unless(ccstreams_str_reset(buf_stream, &buf) == 0, strerror(errno));
+  fail_unless(buf == NULL);
+  fail_unless(counting.live == 1);
+
+  fail_unless(ccstreams_str_reset(buf_stream, &other) == 0, strerror(errno));
+  fail_unless(buf != NULL && buf[0] == '\0');
+  fail_unless(other == NULL);
+
+  fail_unless(fputs("other", buf_stream) >= 0, strerror(errno));
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+  fail_unless(strcmp(other, "other") == 0, other);
+
+  allocator.free(allocator.context, buf, 1);
+  allocator.free(allocator.context, other, strlen(other) + 1);
+  fail_unless(counting.live == 0);
+
+  /* Eagerly. */
+  options.flags = 0;
+  counting.calls = 0;
+  buf = NULL;
+
+  buf_stream = ccstreams_fstropen_options(&buf, "w+", &options);
+  fail_unless(buf_stream != NULL, strerror(errno));
+  fail_unless(counting.calls == 2);
+  fail_unless(buf != NULL && buf[0] == '\0');
+  fail_unless(fclose(buf_stream) == 0, strerror(errno));
+
+  allocator.free(allocator.context, buf, 1);
+  fail_unless(counting.live == 0);
+}
+END_TEST
+
+START_TEST(str_rw_peek)
+{
+  int status = 0;
+  const char *data = NULL;
+  size_t avail = 0;
+
+  /* Pending output is flushed. */
+  fail_unless(fputs("Jello", stream) >= 0, strerror(errno));
+
+  status = ccstreams_peek(stream, &data, &avail);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(data == str + 5);
+  fail_unless(avail == sizeof(STR_RW_INITIAL) - 6);
+  fail_unless(strcmp(data, " World!") == 0);
+  fail_unless(strcmp(str, "Jello World!") == 0);
+
+  status = ccstreams_consume(stream, avail);
+  fail_unless(status == 0, strerror(errno));
+  fail_unless(fgetc(stream) == EOF);
+}
+END_TEST
+
 Suite *
 str_suite(void)
 {
@@ -152,9 +509,21 @@ str_suite(void)
   tcase_add_test(tc_str_rw, str_rw_seek);
   tcase_add_test(tc_str_rw, str_rw_write_growing);
   tcase_add_test(tc_str_rw, str_rw_write_shrinking);
+  tcase_add_test(tc_str_rw, str_rw_peek);
 
   suite_add_tcase(suite, tc_str_rw);
 
+  TCase *tc_str_options = tcase_create("str options");
+
+  tcase_add_test(tc_str_options, str_options_reopen);
+  tcase_add_test(tc_str_options, str_options_allocator);
+  tcase_add_test(tc_str_options, str_options_reset);
+  tcase_add_test(tc_str_options, str_options_reset_taken);
+  tcase_add_test(tc_str_options, str_options_lazy);
+  tcase_add_test(tc_str_options, str_options_writev);
+
+  suite_add_tcase(suite, tc_str_options);
+
   return suite;
 }
 
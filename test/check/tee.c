@@ -0,0 +1,136 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CCStreams Library.
+ *
+ * The CCStreams Library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * The CCStreams Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CCStreams Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ccstreams/mem.h>
+#include <ccstreams/str.h>
+#include <ccstreams/tee.h>
+
+START_TEST(tee_targets)
+{
+  char *mem = NULL;
+  size_t mem_size = 0;
+  char *str = NULL;
+  char line[64];
+  FILE *targets[3];
+  FILE *tee = NULL;
+  size_t i = 0;
+
+  targets[0] = ccstreams_fmemopen(&mem, &mem_size, "w+");
+  fail_unless(targets[0] != NULL, strerror(errno));
+  targets[1] = ccstreams_fstropen(&str, "w+");
+  fail_unless(targets[1] != NULL, strerror(errno));
+  targets[2] = tmpfile();
+  fail_unless(targets[2] != NULL, strerror(errno));
+
+  /* Output already pending on a target stays in order. */
+  fail_unless(fputs("> ", targets[0]) >= 0, strerror(errno));
+
+  tee = ccstreams_fteeopen(targets, 3);
+  fail_unless(tee != NULL, strerror(errno));
+
+  for (i = 0; i < 3; i++) {
+    fail_unless(fprintf(tee, "record %zu\n", i) > 0, strerror(errno));
+  }
+
+  fail_unless(fclose(tee) == 0, strerror(errno));
+
+  fail_unless(mem_size == 2 + 27);
+  fail_unless(memcmp(mem, "> record 0\nrecord 1\nrecord 2\n", mem_size) == 0);
+  fail_unless(strcmp(str, "record 0\nrecord 1\nrecord 2\n") == 0, str);
+
+  /* The targets are left open and carry on. */
+  fail_unless(fputs("!", targets[1]) >= 0, strerror(errno));
+  fail_unless(fclose(targets[1]) == 0, strerror(errno));
+  fail_unless(strcmp(str, "record 0\nrecord 1\nrecord 2\n!") == 0, str);
+
+  rewind(targets[2]);
+  fail_unless(fgets(line, sizeof(line), targets[2]) != NULL, strerror(errno));
+  fail_unless(strcmp(line, "record 0\n") == 0, line);
+
+  fail_unless(fclose(targets[0]) == 0, strerror(errno));
+  fail_unless(fclose(targets[2]) == 0, strerror(errno));
+
+  free(mem);
+  free(str);
+}
+END_TEST
+
+START_TEST(tee_error)
+{
+  char *str = NULL;
+  FILE *targets[2];
+  FILE *tee = NULL;
+
+  targets[0] = fopen("/dev/full", "w");
+  fail_unless(targets[0] != NULL, strerror(errno));
+  setvbuf(targets[0], NULL, _IONBF, 0);
+  targets[1] = ccstreams_fstropen(&str, "w+");
+  fail_unless(targets[1] != NULL, strerror(errno));
+
+  tee = ccstreams_fteeopen(targets, 2);
+  fail_unless(tee != NULL, strerror(errno));
+
+  fail_unless(fputs("Hello World!", tee) >= 0, strerror(errno));
+  fail_unless(fflush(tee) == EOF);
+  fail_unless(errno == ENOSPC);
+
+  /* The other target still got it. */
+  fail_unless(strcmp(str, "Hello World!") == 0, str);
+
+  fclose(tee);
+  fclose(targets[0]);
+  fail_unless(fclose(targets[1]) == 0, strerror(errno));
+  free(str);
+}
+END_TEST
+
+Suite *
+tee_suite(void)
+{
+  Suite *suite = suite_create("tee");
+
+  TCase *tc_tee = tcase_create("tee");
+
+  tcase_add_test(tc_tee, tee_targets);
+  tcase_add_test(tc_tee, tee_error);
+
+  suite_add_tcase(suite, tc_tee);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *sr = srunner_create(tee_suite());
+
+  srunner_run_all(sr, CK_NORMAL);
+  failed = srunner_ntests_failed(sr);
+
+  srunner_free(sr);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}